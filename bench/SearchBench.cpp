@@ -0,0 +1,817 @@
+// Search engine benchmark. Builds an index of a synthetic file tree, then
+// times a fixed query set against it, cold (index evicted from the file
+// cache, fresh service) and warm. --scan also times the enumerator the
+// index builder uses on a real tree: the MFT of a drive ("C:") on Windows,
+// a directory on one filesystem elsewhere. --fs-tree (POSIX only) creates a
+// synthetic directory tree under --dir, DEPTH levels of FANOUT directories
+// each holding FILES empty files, and times PosixEnumerator on it, with and
+// without the per-file stat the index's size and time columns need, against
+// a recursive readdir + lstat walk, --warm-runs times each after an untimed
+// walk. Everything is reported as one JSON object
+// so runs can be diffed between releases.
+//
+//   SearchBench [--entries N] [--seed S] [--budget MB] [--warm-runs R]
+//               [--cold-runs R] [--dir PATH] [--out FILE] [--skip-trigram-index]
+//               [--scan ROOT] [--fs-tree DEPTH FANOUT FILES]
+//
+// Builds with SearchBench.vcxproj on Windows, or elsewhere with e.g.
+//   g++ -std=c++20 -O2 -I. bench/SearchBench.cpp -o SearchBench -lpthread
+
+#include "../src/search/FileSearchService.h"
+#include "../src/search/TrigramIndex.h"
+#include "../src/search/Utf8.h"
+#include <chrono>
+#include <cstdio>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#include "../src/search/MftEnumerator.h"
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include "../src/search/PosixEnumerator.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Zipf(s) over ranks [0, n): rank 0 is by far the most likely.
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double s) : cumulative_(n) {
+        double total = 0;
+        for (size_t i = 0; i < n; ++i) {
+            total += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cumulative_[i] = total;
+        }
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) const {
+        double u = std::uniform_real_distribution<double>(0, cumulative_.back())(rng);
+        size_t rank = std::upper_bound(cumulative_.begin(), cumulative_.end(), u) - cumulative_.begin();
+        return std::min(rank, cumulative_.size() - 1);
+    }
+
+private:
+    std::vector<double> cumulative_;
+};
+
+// A single-drive tree shaped like a developer machine: a few huge
+// directories and many small ones (Pareto file counts), chains up to
+// MAX_DEPTH deep, and names drawn from a Zipf vocabulary so that common
+// stems and extensions repeat across the tree the way they do on disk.
+// The vocabulary is the same for every seed; the seed only shapes the tree.
+class SyntheticTree {
+public:
+    explicit SyntheticTree(uint64_t seed)
+        : rng_(seed), words_(VOCABULARY_SIZE, 1.05), dirWords_(std::size(DIR_NAMES), 1.2),
+          exts_(std::size(EXTENSIONS), 1.1) {
+        vocabulary_.assign(std::begin(COMMON_WORDS), std::end(COMMON_WORDS));
+        for (size_t i = vocabulary_.size(); i < VOCABULARY_SIZE; ++i) {
+            vocabulary_.push_back(syntheticWord(i));
+        }
+    }
+
+    // Directories are emitted before anything below them.
+    void generate(uint32_t count, const IndexBuilder::AddEntry& add) {
+        struct Pending {
+            uint64_t ref;
+            uint32_t depth;
+        };
+        std::vector<Pending> stack;
+        uint64_t nextRef = FIRST_REF;
+        uint32_t emitted = 0;
+
+        auto addDir = [&](uint64_t parent, uint32_t depth) {
+            uint64_t ref = nextRef++;
+            add(ref, parent, dirName(), FileAttributes::DIRECTORY, DRIVE_INDEX, FileMetadata::UNKNOWN_SIZE,
+                modifiedTime());
+            stack.push_back({ ref, depth });
+            ++emitted;
+            ++directories_;
+            maxDepth_ = std::max(maxDepth_, depth);
+        };
+
+        while (emitted < count) {
+            if (stack.empty()) {
+                addDir(ROOT_REF, 1);
+                continue;
+            }
+
+            Pending dir = stack.back();
+            stack.pop_back();
+
+            uint32_t files = std::min(fileCount(), count - emitted);
+            for (uint32_t i = 0; i < files; ++i) {
+                std::wstring name = fileName();
+                uint8_t attributes = name[0] == L'.' ? FileAttributes::HIDDEN : 0;
+                add(nextRef++, dir.ref, name, attributes, DRIVE_INDEX, fileSize(), modifiedTime());
+            }
+            emitted += files;
+
+            uint32_t subdirs = dir.depth < MAX_DEPTH ? subdirCount(dir.depth) : 0;
+            for (uint32_t i = 0; i < subdirs && emitted < count; ++i) {
+                addDir(dir.ref, dir.depth + 1);
+            }
+        }
+    }
+
+    uint32_t directories() const { return directories_; }
+    uint32_t maxDepth() const { return maxDepth_; }
+
+private:
+    static constexpr uint64_t ROOT_REF = 5;    // the NTFS root directory's ref
+    static constexpr uint64_t FIRST_REF = 64;
+    static constexpr uint8_t DRIVE_INDEX = 2;  // C:
+    static constexpr uint32_t MAX_DEPTH = 32;
+    static constexpr size_t VOCABULARY_SIZE = 40000;
+    // fixed rather than the clock, so the same seed builds the same index
+    static constexpr uint32_t NEWEST_TIME = 1767225600;  // 2026-01-01
+    static constexpr uint32_t TIME_SPAN = 5 * 365 * 24 * 60 * 60;
+
+    static constexpr const wchar_t* COMMON_WORDS[] = {
+        L"index", L"main", L"config", L"test", L"util", L"render", L"glyph", L"search", L"file",
+        L"data", L"app", L"core", L"common", L"string", L"buffer", L"window", L"image", L"font",
+        L"parser", L"client", L"server", L"module", L"plugin", L"theme", L"style", L"layout",
+        L"resource", L"manager", L"service", L"handler", L"helper", L"worker", L"cache", L"stream",
+        L"debug", L"release", L"package", L"license", L"readme", L"changelog", L"version",
+        L"\u6771\u4eac", L"r\u00e9sum\u00e9", L"\u00dcbersicht", L"\u0434\u0430\u043d\u043d\u044b\u0435",
+    };
+
+    static constexpr const wchar_t* DIR_NAMES[] = {
+        L"src", L"lib", L"bin", L"obj", L"include", L"test", L"docs", L"assets", L"node_modules",
+        L"build", L"x64", L"Release", L"Debug", L"packages", L"vendor", L"dist", L"scripts",
+        L"Program Files", L"Windows", L"System32", L"Users", L"AppData", L"Local", L"Temp",
+        L"cache", L"logs", L"images", L"fonts", L"locales", L"en-US", L"third_party", L".git",
+    };
+
+    static constexpr const wchar_t* EXTENSIONS[] = {
+        L"js", L"h", L"cpp", L"dll", L"png", L"json", L"txt", L"py", L"cs", L"xml", L"md",
+        L"ts", L"html", L"css", L"go", L"rs", L"java", L"class", L"pdb", L"obj", L"lib",
+        L"exe", L"svg", L"jpg", L"log", L"ini", L"yml", L"mp3",
+    };
+
+    static constexpr const wchar_t* FIXED_NAMES[] = {
+        L"index.js", L"package.json", L"README.md", L"__init__.py", L"Makefile", L".gitignore",
+        L"LICENSE", L"CMakeLists.txt",
+    };
+
+    // Pronounceable filler for the vocabulary's long tail.
+    static std::wstring syntheticWord(size_t i) {
+        static constexpr const wchar_t* SYLLABLES[] = {
+            L"ka", L"lo", L"mi", L"ne", L"ru", L"ta", L"vo", L"xi", L"ber", L"con", L"del",
+            L"for", L"gen", L"han", L"pro", L"str", L"tor", L"zen", L"qu", L"ph",
+        };
+        uint64_t h = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        size_t syllables = 2 + (h >> 60) % 3;
+        std::wstring word;
+        for (size_t s = 0; s < syllables; ++s) {
+            word += SYLLABLES[(h >> (s * 8)) % std::size(SYLLABLES)];
+        }
+        return word;
+    }
+
+    double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng_); }
+
+    const std::wstring& word() { return vocabulary_[words_(rng_)]; }
+
+    std::wstring dirName() {
+        if (uniform() < 0.5) return DIR_NAMES[dirWords_(rng_)];
+        std::wstring name = word();
+        if (uniform() < 0.2) name += L"-" + word();
+        return name;
+    }
+
+    std::wstring fileName() {
+        double u = uniform();
+        if (u < 0.05) return FIXED_NAMES[std::uniform_int_distribution<size_t>(0, std::size(FIXED_NAMES) - 1)(rng_)];
+
+        std::wstring stem = word();
+        if (u < 0.35) {
+            stem += L"_" + word();
+        } else if (u < 0.5) {
+            stem += std::to_wstring(std::uniform_int_distribution<int>(0, 999)(rng_));
+        }
+        if (uniform() < 0.1) stem[0] = static_cast<wchar_t>(towupper(stem[0]));
+        return stem + L"." + EXTENSIONS[exts_(rng_)];
+    }
+
+    // Pareto: most directories hold a handful of files, a few thousands.
+    uint32_t fileCount() {
+        double files = 2.0 / std::pow(1.0 - uniform(), 1.0 / 1.3);
+        return static_cast<uint32_t>(std::min(files, 20000.0)) - 1;
+    }
+
+    // Log-normal around a few KB, with a long tail of large binaries.
+    uint64_t fileSize() {
+        double size = std::lognormal_distribution<double>(8.5, 2.5)(rng_);
+        return static_cast<uint64_t>(std::min(size, 64.0 * 1024 * 1024 * 1024));
+    }
+
+    // Skewed toward recent edits: most files are weeks old, some years.
+    uint32_t modifiedTime() {
+        double age = std::pow(uniform(), 3.0) * TIME_SPAN;
+        return NEWEST_TIME - static_cast<uint32_t>(age);
+    }
+
+    // Bushy near the root, thinning out with depth so the tree stays finite.
+    uint32_t subdirCount(uint32_t depth) {
+        double mean = depth < 4 ? 6.0 : depth < 12 ? 1.6 : 0.6;
+        return std::geometric_distribution<uint32_t>(1.0 / (1.0 + mean))(rng_);
+    }
+
+    std::mt19937_64 rng_;
+    std::vector<std::wstring> vocabulary_;
+    ZipfSampler words_;
+    ZipfSampler dirWords_;
+    ZipfSampler exts_;
+    uint32_t directories_ = 0;
+    uint32_t maxDepth_ = 0;
+};
+
+struct Query {
+    const wchar_t* text;
+    bool fuzzy;
+};
+
+// Fixed so results stay comparable between releases: short queries, common
+// and rare substrings, an extension, a miss, a scoped query, non-ASCII,
+// fuzzy queries and metadata filters.
+const Query QUERIES[] = {
+    { L"c", false },
+    { L"re", false },
+    { L"cpp", false },
+    { L"config", false },
+    { L"index.js", false },
+    { L"render_glyph", false },
+    { L"kalomi", false },
+    { L"zzqx", false },
+    { L"src/ main", false },
+    { L"\u6771\u4eac", false },
+    { L"srcmn", true },
+    { L"cfgjs", true },
+    { L"ext:log", false },
+    { L"ext:cpp,h size:>10kb", false },
+    { L"main sort:size", false },
+};
+
+struct Latency {
+    double p50 = 0, p90 = 0, p99 = 0, max = 0, mean = 0;
+
+    static Latency of(std::vector<double> samples) {
+        Latency l;
+        if (samples.empty()) return l;
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double q) { return samples[static_cast<size_t>(q * (samples.size() - 1) + 0.5)]; };
+        l.p50 = at(0.50);
+        l.p90 = at(0.90);
+        l.p99 = at(0.99);
+        l.max = samples.back();
+        for (double s : samples) l.mean += s;
+        l.mean /= samples.size();
+        return l;
+    }
+};
+
+struct MemoryUsage {
+    size_t current = 0;
+    size_t peak = 0;
+};
+
+MemoryUsage memoryUsage() {
+    MemoryUsage m;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        m.current = pmc.WorkingSetSize;
+        m.peak = pmc.PeakWorkingSetSize;
+    }
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) m.peak = static_cast<size_t>(usage.ru_maxrss) * 1024;
+    if (FILE* f = fopen("/proc/self/statm", "r")) {
+        unsigned long pages = 0, resident = 0;
+        if (fscanf(f, "%lu %lu", &pages, &resident) == 2) {
+            m.current = resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+        fclose(f);
+    }
+#endif
+    return m;
+}
+
+// Drops the file's pages from the OS file cache, so the next open reads
+// from disk. Only works while nothing has the file mapped.
+bool evictFromCache(const std::filesystem::path& path) {
+#ifdef _WIN32
+    // an unbuffered open makes the cache manager flush and purge the file
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    CloseHandle(h);
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+#ifndef _WIN32
+// A tree of empty files on disk for timing the enumerator: every directory
+// down to depth holds fanout subdirectories, and every directory, the root
+// included, holds files files. Left in place and reused by later runs with
+// the same shape, since creating it takes far longer than walking it.
+struct FsTree {
+    std::filesystem::path root;
+    uint32_t files = 0;
+    uint32_t directories = 0;  // below the root
+    double createMs = 0;       // 0 if an earlier run's tree was reused
+
+    static FsTree create(const std::filesystem::path& dir, uint32_t depth, uint32_t fanout, uint32_t files) {
+        FsTree tree;
+        tree.root = dir / ("fs-tree-" + std::to_string(depth) + "-" + std::to_string(fanout) + "-" +
+                           std::to_string(files));
+        std::filesystem::path complete = tree.root / ".complete";
+        bool reuse = std::filesystem::exists(complete);
+
+        auto start = Clock::now();
+        tree.fill(tree.root, depth, fanout, files, !reuse);
+        if (!reuse) {
+            std::ofstream(complete.string());
+            tree.createMs = elapsedMs(start);
+        }
+        ++tree.files;  // the marker
+        return tree;
+    }
+
+private:
+    // counts the tree's entries, creating them too if create
+    void fill(const std::filesystem::path& dir, uint32_t depth, uint32_t fanout, uint32_t fileCount, bool create) {
+        if (create) std::filesystem::create_directories(dir);
+        for (uint32_t i = 0; i < fileCount; ++i) {
+            if (create) {
+                std::string path = (dir / ("file" + std::to_string(i) + ".txt")).string();
+                int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+                if (fd >= 0) close(fd);
+            }
+            ++files;
+        }
+        if (depth == 0) return;
+        for (uint32_t i = 0; i < fanout; ++i) {
+            ++directories;
+            fill(dir / ("dir" + std::to_string(i)), depth - 1, fanout, fileCount, create);
+        }
+    }
+};
+
+// What PosixEnumerator is measured against: one thread, readdir and an
+// lstat per entry, like find(1).
+void readdirWalk(const std::string& path, uint32_t& files, uint32_t& directories) {
+    DIR* d = opendir(path.c_str());
+    if (!d) return;
+    while (dirent* e = readdir(d)) {
+        const char* name = e->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+
+        std::string child = path + '/' + name;
+        struct stat st;
+        if (lstat(child.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            ++directories;
+            readdirWalk(child, files, directories);
+        } else {
+            ++files;
+        }
+    }
+    closedir(d);
+}
+#endif
+
+// Results of one search, waiting for the final callback.
+size_t runQuery(FileSearchService& service, const Query& query) {
+    service.setFuzzyMatching(query.fuzzy);
+    std::promise<size_t> done;
+    auto count = done.get_future();
+    service.search(query.text, [&](const std::vector<SearchResult>& results, bool complete) {
+        if (complete) done.set_value(results.size());
+    });
+    return count.get();
+}
+
+class JsonWriter {
+public:
+    void begin(const char* key = nullptr) { open(key, '{'); }
+    void end() { close('}'); }
+    void beginArray(const char* key) { open(key, '['); }
+    void endArray() { close(']'); }
+
+    void value(const char* key, double v) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.3f", v);
+        field(key) << buf;
+    }
+    void value(const char* key, uint64_t v) { field(key) << v; }
+    void value(const char* key, uint32_t v) { field(key) << v; }
+    void value(const char* key, bool v) { field(key) << (v ? "true" : "false"); }
+    void value(const char* key, const std::wstring& v) { field(key) << '"' << escape(v) << '"'; }
+
+    void latency(const char* key, const Latency& l) {
+        begin(key);
+        value("p50", l.p50);
+        value("p90", l.p90);
+        value("p99", l.p99);
+        value("max", l.max);
+        value("mean", l.mean);
+        end();
+    }
+
+    std::string str() const { return out_.str() + "\n"; }
+
+private:
+    std::ostringstream& field(const char* key) {
+        if (!first_) out_ << ',';
+        first_ = false;
+        out_ << '\n' << std::string(depth_ * 2, ' ');
+        if (key) out_ << '"' << key << "\": ";
+        return out_;
+    }
+
+    void open(const char* key, char bracket) {
+        if (depth_ > 0) {
+            field(key) << bracket;
+        } else {
+            out_ << bracket;
+        }
+        ++depth_;
+        first_ = true;
+    }
+
+    void close(char bracket) {
+        --depth_;
+        out_ << '\n' << std::string(depth_ * 2, ' ') << bracket;
+        first_ = false;
+    }
+
+    // UTF-8, with JSON escapes
+    static std::string escape(const std::wstring& s) {
+        std::string out;
+        for (char c : Utf8::encode(s)) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    std::ostringstream out_;
+    int depth_ = 0;
+    bool first_ = true;
+};
+
+struct Options {
+    uint32_t entries = 1000000;
+    uint64_t seed = 1;
+    size_t budgetBytes = 0;
+    uint32_t warmRuns = 25;
+    uint32_t coldRuns = 3;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "velocitty-bench";
+    std::string out;
+    bool trigramIndex = true;
+    std::string scanRoot;
+    uint32_t fsTreeDepth = 0;  // no --fs-tree
+    uint32_t fsTreeFanout = 0;
+    uint32_t fsTreeFiles = 0;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--entries" && hasValue) {
+            options.entries = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--budget" && hasValue) {
+            options.budgetBytes = std::stoull(argv[++i]) * 1024 * 1024;
+        } else if (arg == "--warm-runs" && hasValue) {
+            options.warmRuns = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--cold-runs" && hasValue) {
+            options.coldRuns = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--dir" && hasValue) {
+            options.dir = argv[++i];
+        } else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else if (arg == "--skip-trigram-index") {
+            options.trigramIndex = false;
+        } else if (arg == "--scan" && hasValue) {
+            options.scanRoot = argv[++i];
+        } else if (arg == "--fs-tree" && i + 3 < argc) {
+            options.fsTreeDepth = std::max(1ul, std::stoul(argv[++i]));
+            options.fsTreeFanout = std::max(1ul, std::stoul(argv[++i]));
+            options.fsTreeFiles = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            fprintf(stderr,
+                    "usage: SearchBench [--entries N] [--seed S] [--budget MB] [--warm-runs R]\n"
+                    "                   [--cold-runs R] [--dir PATH] [--out FILE] [--skip-trigram-index]\n"
+                    "                   [--scan ROOT] [--fs-tree DEPTH FANOUT FILES]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 2;
+
+    std::filesystem::create_directories(options.dir);
+    std::filesystem::path indexPath = options.dir / "bench.idx";
+
+    JsonWriter json;
+    json.begin();
+    json.value("benchVersion", uint32_t{ 1 });
+    json.value("indexFormat", DiskIndexHeader::VERSION);
+    json.value("hardwareThreads", std::thread::hardware_concurrency());
+    json.value("searchWorkers", static_cast<uint64_t>(SearchWorkerPool::defaultSize()));
+
+    // a real tree, through the enumerator IndexBuilder::build runs per volume
+    if (!options.scanRoot.empty()) {
+        fprintf(stderr, "scanning %s...\n", options.scanRoot.c_str());
+        uint32_t files = 0;
+        uint32_t directories = 0;
+        auto count = [&](const std::wstring&, uint64_t, uint64_t, uint32_t attributes, uint64_t, uint32_t) {
+            ++(attributes & FileAttributes::DIRECTORY ? directories : files);
+        };
+        std::atomic<bool> cancel{ false };
+        auto start = Clock::now();
+#ifdef _WIN32
+        bool scanned = MftEnumerator().enumerateDrive(static_cast<wchar_t>(towupper(options.scanRoot[0])), count, cancel);
+#else
+        PosixEnumerator enumerator;
+        enumerator.setReadMetadata(true);  // as IndexBuilder runs it
+        bool scanned = enumerator.enumerate(options.scanRoot, count, cancel);
+#endif
+        double scanMs = elapsedMs(start);
+        if (!scanned) {
+            fprintf(stderr, "can't scan %s\n", options.scanRoot.c_str());
+            return 1;
+        }
+
+        json.begin("scan");
+        json.value("root", Utf8::decode(options.scanRoot));
+        json.value("files", files);
+        json.value("directories", directories);
+        json.value("ms", scanMs);
+        json.end();
+    }
+
+    // a synthetic tree on disk, walked by the enumerator and by readdir;
+    // each walk runs once untimed first, so all of them read a warm cache
+    if (options.fsTreeDepth > 0) {
+#ifdef _WIN32
+        fprintf(stderr, "--fs-tree times PosixEnumerator, which is POSIX only\n");
+        return 2;
+#else
+        fprintf(stderr, "creating and walking a depth %u, fan-out %u tree...\n", options.fsTreeDepth,
+                options.fsTreeFanout);
+        FsTree tree = FsTree::create(options.dir, options.fsTreeDepth, options.fsTreeFanout, options.fsTreeFiles);
+        std::string root = tree.root.string();
+
+        auto timeWalk = [&](auto&& walk, uint32_t& entries) {
+            std::vector<double> samples;
+            for (uint32_t run = 0; run <= options.warmRuns; ++run) {
+                entries = 0;
+                auto start = Clock::now();
+                walk(entries);
+                if (run > 0) samples.push_back(elapsedMs(start));
+            }
+            return Latency::of(std::move(samples));
+        };
+        auto enumerator = [&](unsigned threads, bool metadata) {
+            return [&root, threads, metadata](uint32_t& entries) {
+                std::atomic<bool> cancel{ false };
+                PosixEnumerator walk(threads);
+                walk.setReadMetadata(metadata);
+                walk.enumerate(
+                    root, [&](const std::wstring&, uint64_t, uint64_t, uint32_t, uint64_t, uint32_t) { ++entries; },
+                    cancel);
+            };
+        };
+
+        const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        uint32_t oneThreadEntries = 0;
+        uint32_t allThreadsEntries = 0;
+        uint32_t metadataEntries = 0;
+        uint32_t readdirEntries = 0;
+        Latency oneThread = timeWalk(enumerator(1, false), oneThreadEntries);
+        Latency allThreads = timeWalk(enumerator(threads, false), allThreadsEntries);
+        Latency withMetadata = timeWalk(enumerator(threads, true), metadataEntries);
+        Latency readdir = timeWalk([&](uint32_t& entries) {
+            uint32_t files = 0;
+            uint32_t directories = 0;
+            readdirWalk(root, files, directories);
+            entries = files + directories;
+        }, readdirEntries);
+
+        json.begin("fsTree");
+        json.value("root", Utf8::decode(root));
+        json.value("depth", options.fsTreeDepth);
+        json.value("fanout", options.fsTreeFanout);
+        json.value("filesPerDirectory", options.fsTreeFiles);
+        json.value("files", tree.files);
+        json.value("directories", tree.directories);
+        json.value("createMs", tree.createMs);
+        json.begin("enumeratorOneThread");
+        json.value("entries", oneThreadEntries);
+        json.latency("ms", oneThread);
+        json.end();
+        json.begin("enumerator");
+        json.value("threads", threads);
+        json.value("entries", allThreadsEntries);
+        json.latency("ms", allThreads);
+        json.end();
+        json.begin("enumeratorWithMetadata");
+        json.value("threads", threads);
+        json.value("entries", metadataEntries);
+        json.latency("ms", withMetadata);
+        json.end();
+        json.begin("readdirLstat");
+        json.value("entries", readdirEntries);
+        json.latency("ms", readdir);
+        json.end();
+        json.end();
+#endif
+    }
+
+    // build
+    fprintf(stderr, "building %u entries...\n", options.entries);
+    SyntheticTree tree(options.seed);
+    std::atomic<bool> cancel{ false };
+    auto buildStart = Clock::now();
+    IndexBuilder::BuildStats stats;
+    {
+        IndexBuilder builder;
+        builder.setMemoryBudget(options.budgetBytes);
+        stats = builder.buildFrom(
+            [&](const IndexBuilder::AddEntry& add) { tree.generate(options.entries, add); },
+            indexPath.wstring(), cancel);
+    }
+    double buildMs = elapsedMs(buildStart);
+    MemoryUsage afterBuild = memoryUsage();
+
+    json.begin("corpus");
+    json.value("entries", stats.filesIndexed);
+    json.value("directories", tree.directories());
+    json.value("maxDepth", tree.maxDepth());
+    json.value("seed", options.seed);
+    json.end();
+
+    std::error_code ec;
+    json.begin("build");
+    json.value("ms", buildMs);
+    json.value("indexBytes", static_cast<uint64_t>(std::filesystem::file_size(indexPath, ec)));
+    json.value("keys", stats.trigramsCreated);
+    json.value("memoryBudgetBytes", static_cast<uint64_t>(options.budgetBytes));
+    json.value("peakWorkingSetBytes", static_cast<uint64_t>(afterBuild.peak));
+    json.end();
+
+    // cold: a fresh service per run, with the index out of the file cache
+    fprintf(stderr, "cold queries...\n");
+    std::vector<std::vector<double>> cold(std::size(QUERIES));
+    bool evicted = true;
+    for (uint32_t run = 0; run < options.coldRuns; ++run) {
+        for (size_t q = 0; q < std::size(QUERIES); ++q) {
+            evicted = evictFromCache(indexPath) && evicted;
+            FileSearchService service;
+            auto start = Clock::now();
+            if (!service.openIndex(indexPath.wstring())) {
+                fprintf(stderr, "can't open %s\n", indexPath.string().c_str());
+                return 1;
+            }
+            runQuery(service, QUERIES[q]);
+            cold[q].push_back(elapsedMs(start));
+        }
+    }
+
+    // warm: one service, every query run once untimed first; the query
+    // cache is reset so each run searches the index rather than narrowing
+    fprintf(stderr, "warm queries...\n");
+    FileSearchService service;
+    auto openStart = Clock::now();
+    service.openIndex(indexPath.wstring());
+    double openMs = elapsedMs(openStart);
+
+    std::vector<size_t> resultCounts(std::size(QUERIES));
+    for (size_t q = 0; q < std::size(QUERIES); ++q) {
+        resultCounts[q] = runQuery(service, QUERIES[q]);
+    }
+
+    std::vector<std::vector<double>> warm(std::size(QUERIES));
+    for (uint32_t run = 0; run < options.warmRuns; ++run) {
+        for (size_t q = 0; q < std::size(QUERIES); ++q) {
+            service.resetQueryCache();
+            auto start = Clock::now();
+            runQuery(service, QUERIES[q]);
+            warm[q].push_back(elapsedMs(start));
+        }
+    }
+    MemoryUsage afterSearch = memoryUsage();
+
+    json.begin("search");
+    json.value("openMs", openMs);
+    json.value("coldCacheEvicted", evicted);
+    json.value("workingSetBytes", static_cast<uint64_t>(afterSearch.current));
+    json.beginArray("queries");
+    for (size_t q = 0; q < std::size(QUERIES); ++q) {
+        json.begin();
+        json.value("query", std::wstring(QUERIES[q].text));
+        json.value("fuzzy", QUERIES[q].fuzzy);
+        json.value("results", static_cast<uint64_t>(resultCounts[q]));
+        json.latency("coldMs", Latency::of(cold[q]));
+        json.latency("warmMs", Latency::of(warm[q]));
+        json.end();
+    }
+    json.endArray();
+    json.end();
+
+    // the in-memory TrigramIndex over the same names, for comparison;
+    // it only finds candidates for 3+ char queries and doesn't verify them
+    if (options.trigramIndex) {
+        fprintf(stderr, "in-memory trigram index...\n");
+        DiskIndex index;
+        index.open(indexPath.wstring());
+
+        TrigramIndex trigrams;
+        auto start = Clock::now();
+        for (uint32_t idx = 0; idx < index.baseEntryCount(); ++idx) {
+            trigrams.addFile(idx, index.getName(idx));
+        }
+        double trigramBuildMs = elapsedMs(start);
+
+        json.begin("trigramIndex");
+        json.value("buildMs", trigramBuildMs);
+        json.value("memoryBytes", static_cast<uint64_t>(trigrams.memoryUsage()));
+        json.beginArray("queries");
+        for (const auto& query : QUERIES) {
+            std::wstring_view text = query.text;
+            if (query.fuzzy || text.size() < 3 || text.find_first_of(L"/\\ ") != std::wstring_view::npos) continue;
+
+            size_t candidates = trigrams.search(text).size();
+            std::vector<double> samples;
+            for (uint32_t run = 0; run < options.warmRuns; ++run) {
+                auto queryStart = Clock::now();
+                trigrams.search(text);
+                samples.push_back(elapsedMs(queryStart));
+            }
+
+            json.begin();
+            json.value("query", std::wstring(text));
+            json.value("candidates", static_cast<uint64_t>(candidates));
+            json.latency("warmMs", Latency::of(std::move(samples)));
+            json.end();
+        }
+        json.endArray();
+        json.end();
+    }
+
+    json.end();
+
+    std::string report = json.str();
+    if (options.out.empty()) {
+        fputs(report.c_str(), stdout);
+    } else if (FILE* f = fopen(options.out.c_str(), "wb")) {
+        fputs(report.c_str(), f);
+        fclose(f);
+    } else {
+        fprintf(stderr, "can't write %s\n", options.out.c_str());
+        return 1;
+    }
+    return 0;
+}
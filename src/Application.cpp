@@ -68,10 +68,13 @@ int Application::run(HINSTANCE hInstance) {
 
         if (!running_) break;
 
-        PaneContainer* activeTab = tabManager_.getActiveTab();
-        if (activeTab) {
-            for (const auto& pane : activeTab->getPanes()) {
+        // background tabs are drained too: a shell whose ConPTY pipe fills
+        // up blocks until someone reads it, however long it stays hidden
+        bool anyRunning = false;
+        for (const auto& tab : tabManager_.getTabs()) {
+            for (const auto& pane : tab->getPanes()) {
                 pane->getTerminal().processOutput();
+                anyRunning = anyRunning || pane->getTerminal().isRunning();
             }
         }
 
@@ -79,16 +82,6 @@ int Application::run(HINSTANCE hInstance) {
             render();
         }
 
-        bool anyRunning = false;
-        if (activeTab) {
-            for (const auto& pane : activeTab->getPanes()) {
-                if (pane->getTerminal().isRunning()) {
-                    anyRunning = true;
-                    break;
-                }
-            }
-        }
-
         if (!anyRunning) {
             Sleep(1);
         }
@@ -629,7 +622,9 @@ void Application::onChar(wchar_t ch) {
                         if (fileSearchOverlay_) {
                             fileSearchOverlay_->setResults(results, complete);
                         }
-                    });
+                    },
+                    fileSearchOverlay_->isContentMode() ? FileSearchService::SearchMode::Contents
+                                                        : FileSearchService::SearchMode::Names);
             }
             return;
         }
@@ -719,7 +714,9 @@ void Application::onKeyDown(UINT vk) {
                         if (fileSearchOverlay_) {
                             fileSearchOverlay_->setResults(results, complete);
                         }
-                    });
+                    },
+                    fileSearchOverlay_->isContentMode() ? FileSearchService::SearchMode::Contents
+                                                        : FileSearchService::SearchMode::Names);
             }
             if (fileSearchOverlay_->hasAction()) {
                 executeFileAction();
@@ -1468,6 +1465,10 @@ void Application::toggleFullscreen() {
 void Application::initFileSearch() {
     fileSearchOverlay_ = std::make_unique<FileSearchOverlay>();
     fileSearchService_ = std::make_unique<FileSearchService>();
+    fileSearchService_->setIndexMemoryBudget(
+        static_cast<size_t>(Config::instance().getSearch().indexMemoryBudgetMB) * 1024 * 1024);
+    fileSearchService_->setLiveUpdates(Config::instance().getSearch().liveIndexUpdates);
+    fileSearchService_->setFuzzyMatching(Config::instance().getSearch().fuzzyMatching);
     fileSearchService_->startIndexing();
 }
 
@@ -1483,6 +1484,9 @@ void Application::toggleFileSearch() {
             static_cast<float>(windowWidth_),
             static_cast<float>(windowHeight_)
         );
+        if (fileSearchService_) {
+            fileSearchService_->resetQueryCache();
+        }
         fileSearchOverlay_->show();
     }
 }
@@ -1530,6 +1534,9 @@ void Application::executeFileAction() {
 
     if (!cmd.empty()) {
         pane->getTerminal().sendInput(cmd.c_str(), cmd.length());
+        if (fileSearchService_) {
+            fileSearchService_->recordUse(fileSearchOverlay_->getSelectedResult());
+        }
     }
 
     fileSearchOverlay_->clearAction();
@@ -1,4 +1,6 @@
 #include "Config.h"
+#include <algorithm>
+#include <charconv>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
@@ -123,7 +125,13 @@ bool Config::load(const std::wstring& path) {
 
     std::string scrollback = findValue("scrollbackLines");
     if (!scrollback.empty()) {
-        terminal_.scrollbackLines = static_cast<uint16_t>(std::stoi(scrollback));
+        // clamped rather than truncated, which turned 100000 into 34464;
+        // anything unparsable keeps the default
+        int64_t lines = 0;
+        auto parsed = std::from_chars(scrollback.data(), scrollback.data() + scrollback.size(), lines);
+        if (parsed.ec == std::errc{}) {
+            terminal_.scrollbackLines = static_cast<uint16_t>(std::clamp<int64_t>(lines, 0, UINT16_MAX));
+        }
     }
 
     std::string cursorBlink = findValue("cursorBlink");
@@ -138,6 +146,15 @@ bool Config::load(const std::wstring& path) {
     std::string height = findValue("windowHeight");
     if (!height.empty()) window_.height = static_cast<uint32_t>(std::stoi(height));
 
+    std::string indexBudget = findValue("indexMemoryBudgetMB");
+    if (!indexBudget.empty()) search_.indexMemoryBudgetMB = static_cast<uint32_t>(std::stoul(indexBudget));
+
+    std::string liveUpdates = findValue("liveIndexUpdates");
+    if (!liveUpdates.empty()) search_.liveIndexUpdates = (liveUpdates == "true");
+
+    std::string fuzzy = findValue("fuzzyMatching");
+    if (!fuzzy.empty()) search_.fuzzyMatching = (fuzzy == "true");
+
     return true;
 }
 
@@ -187,6 +204,12 @@ bool Config::save(const std::wstring& path) {
     file << "    \"windowHeight\": " << window_.height << "\n";
     file << "  },\n";
 
+    file << "  \"search\": {\n";
+    file << "    \"indexMemoryBudgetMB\": " << search_.indexMemoryBudgetMB << ",\n";
+    file << "    \"liveIndexUpdates\": " << (search_.liveIndexUpdates ? "true" : "false") << ",\n";
+    file << "    \"fuzzyMatching\": " << (search_.fuzzyMatching ? "true" : "false") << "\n";
+    file << "  },\n";
+
     file << "  \"keyBindings\": [\n";
     for (size_t i = 0; i < keyBindings_.size(); ++i) {
         const auto& kb = keyBindings_[i];
@@ -225,6 +248,10 @@ void Config::initDefaults() {
     render_.vsync = true;
     render_.dirtyRectOptimization = true;
     render_.opacity = 1.0f;
+
+    search_.indexMemoryBudgetMB = 0;
+    search_.liveIndexUpdates = true;
+    search_.fuzzyMatching = true;
 }
 
 void Config::initDefaultKeyBindings() {
@@ -60,6 +60,12 @@ struct RenderConfig {
     float opacity = 1.0f;
 };
 
+struct SearchConfig {
+    uint32_t indexMemoryBudgetMB = 0;  // 0 = build the index fully in memory
+    bool liveIndexUpdates = true;      // follow the change journal after indexing
+    bool fuzzyMatching = true;         // subsequence matching, e.g. "appcpp" finds App.cpp
+};
+
 struct TitlebarConfig {
     bool customTitlebar = true;
     float height = 32.0f;
@@ -101,6 +107,9 @@ public:
     TitlebarConfig& getTitlebar() { return titlebar_; }
     const TitlebarConfig& getTitlebar() const { return titlebar_; }
 
+    SearchConfig& getSearch() { return search_; }
+    const SearchConfig& getSearch() const { return search_; }
+
     std::vector<KeyBinding>& getKeyBindings() { return keyBindings_; }
     const std::vector<KeyBinding>& getKeyBindings() const { return keyBindings_; }
 
@@ -119,6 +128,7 @@ private:
     TerminalConfig terminal_;
     RenderConfig render_;
     TitlebarConfig titlebar_;
+    SearchConfig search_;
     std::vector<KeyBinding> keyBindings_;
     std::vector<ColorScheme> availableSchemes_;
 
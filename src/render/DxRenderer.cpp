@@ -722,6 +722,20 @@ void DxRenderer::renderBuffer(const ScreenBuffer& buffer, float xOffset, float y
     const uint16_t rows = buffer.getRows();
     const uint16_t cols = buffer.getCols();
 
+    // cells come in runs of one style, so colors are only resolved when the
+    // style changes rather than for every cell
+    struct ResolvedStyle {
+        uint32_t foreground = 0;
+        uint32_t background = 0;
+        uint16_t flags = 0;
+        bool selected = false;
+        bool valid = false;
+
+        uint32_t bg = 0;  // after inverse and selection
+        float fgR = 0, fgG = 0, fgB = 0, fgA = 0;
+        float bgR = 0, bgG = 0, bgB = 0, bgA = 0;
+    } style;
+
     for (uint16_t row = 0; row < rows; ++row) {
         float baseY = row * cellH + yOffset + topPadding_;
 
@@ -739,27 +753,41 @@ void DxRenderer::renderBuffer(const ScreenBuffer& buffer, float xOffset, float y
 
             float x = col * cellW + xOffset + leftPadding_;
 
-            uint32_t fg = cell.attrs.foreground;
-            uint32_t bg = cell.attrs.background;
+            if (!style.valid || cell.attrs.foreground != style.foreground ||
+                cell.attrs.background != style.background || cell.attrs.flags != style.flags ||
+                isSelected != style.selected) {
+                style.foreground = cell.attrs.foreground;
+                style.background = cell.attrs.background;
+                style.flags = cell.attrs.flags;
+                style.selected = isSelected;
+                style.valid = true;
 
-            if (cell.attrs.flags & CellAttributes::Inverse) {
-                std::swap(fg, bg);
-            }
-            if (isSelected) {
-                std::swap(fg, bg);
-            }
+                uint32_t fg = cell.attrs.foreground;
+                uint32_t bg = cell.attrs.background;
+
+                if (cell.attrs.flags & CellAttributes::Inverse) {
+                    std::swap(fg, bg);
+                }
+                if (isSelected) {
+                    std::swap(fg, bg);
+                }
 
-            float fgR = ((fg >> 16) & 0xFF) * (1.0f / 255.0f);
-            float fgG = ((fg >> 8) & 0xFF) * (1.0f / 255.0f);
-            float fgB = (fg & 0xFF) * (1.0f / 255.0f);
-            float fgA = ((fg >> 24) & 0xFF) * (1.0f / 255.0f);
+                style.bg = bg;
+                style.fgR = ((fg >> 16) & 0xFF) * (1.0f / 255.0f);
+                style.fgG = ((fg >> 8) & 0xFF) * (1.0f / 255.0f);
+                style.fgB = (fg & 0xFF) * (1.0f / 255.0f);
+                style.fgA = ((fg >> 24) & 0xFF) * (1.0f / 255.0f);
+
+                style.bgR = ((bg >> 16) & 0xFF) * (1.0f / 255.0f);
+                style.bgG = ((bg >> 8) & 0xFF) * (1.0f / 255.0f);
+                style.bgB = (bg & 0xFF) * (1.0f / 255.0f);
+                style.bgA = ((bg >> 24) & 0xFF) * (1.0f / 255.0f);
+            }
 
-            float bgR = ((bg >> 16) & 0xFF) * (1.0f / 255.0f);
-            float bgG = ((bg >> 8) & 0xFF) * (1.0f / 255.0f);
-            float bgB = (bg & 0xFF) * (1.0f / 255.0f);
-            float bgA = ((bg >> 24) & 0xFF) * (1.0f / 255.0f);
+            const float fgR = style.fgR, fgG = style.fgG, fgB = style.fgB, fgA = style.fgA;
+            const float bgR = style.bgR, bgG = style.bgG, bgB = style.bgB, bgA = style.bgA;
 
-            if (bg != defaultBg || isSelected) {
+            if (style.bg != defaultBg || isSelected) {
                 Vertex b0 = {x, baseY, spaceU, spaceV, bgR, bgG, bgB, bgA, bgR, bgG, bgB, bgA};
                 Vertex b1 = {x + cellW, baseY, spaceU, spaceV, bgR, bgG, bgB, bgA, bgR, bgG, bgB, bgA};
                 Vertex b2 = {x, baseY + cellH, spaceU, spaceV, bgR, bgG, bgB, bgA, bgR, bgG, bgB, bgA};
@@ -772,8 +800,8 @@ void DxRenderer::renderBuffer(const ScreenBuffer& buffer, float xOffset, float y
                 backgroundVertices_.push_back(b3);
             }
 
-            bool bold = (cell.attrs.flags & CellAttributes::Bold) != 0;
-            bool italic = (cell.attrs.flags & CellAttributes::Italic) != 0;
+            bool bold = (style.flags & CellAttributes::Bold) != 0;
+            bool italic = (style.flags & CellAttributes::Italic) != 0;
 
             const GlyphInfo& glyph = glyphAtlas_.getGlyph(cell.codepoint, bold, italic);
             if (!glyph.valid) continue;
@@ -795,7 +823,7 @@ void DxRenderer::renderBuffer(const ScreenBuffer& buffer, float xOffset, float y
             vertices_.push_back(v1);
             vertices_.push_back(v3);
 
-            uint16_t flags = cell.attrs.flags;
+            uint16_t flags = style.flags;
             if (flags & (CellAttributes::Underline | CellAttributes::Hyperlink)) {
                 float underlineY = baseY + cellH - 2.0f;
                 Vertex u0 = {x, underlineY, spaceU, spaceV, fgR, fgG, fgB, fgA, fgR, fgG, fgB, fgA};
@@ -1231,7 +1259,8 @@ void DxRenderer::renderFileSearchOverlay(const FileSearchOverlay& overlay) {
     const std::wstring& query = overlay.getQuery();
 
     if (query.empty()) {
-        renderOverlayText(L"Search files...", textX, textY, textDim, 0);
+        renderOverlayText(overlay.isContentMode() ? L"Search file contents (add a path or ext:)..." : L"Search files...",
+                          textX, textY, textDim, 0);
     } else {
         renderOverlayText(query, textX, textY, textColor, 0);
     }
@@ -1297,6 +1326,7 @@ void DxRenderer::renderFileSearchOverlay(const FileSearchOverlay& overlay) {
         if (remainingChars > 5) {
             float pathX = nameX + (nameLen + 1) * cellW;
             std::wstring displayPath = r.fullPath;
+            if (r.line != 0) displayPath += L":" + std::to_wstring(r.line);
 
             if (displayPath.length() > remainingChars && remainingChars > 3) {
                 displayPath = L"..." + displayPath.substr(displayPath.length() - remainingChars + 3);
@@ -1310,7 +1340,9 @@ void DxRenderer::renderFileSearchOverlay(const FileSearchOverlay& overlay) {
     auto hintBar = overlay.getHintBarRect(winW, winH);
     addOverlayQuad(hintBar.x, hintBar.y - 4, hintBar.w, 1, 0xFF3C3C3C);
 
-    std::wstring hint = L"Enter: select | Shift+Enter: cd parent | Esc: close";
+    std::wstring hint = overlay.isContentMode()
+        ? L"Enter: insert path | Shift+Enter: cd parent | Tab: search names | Esc: close"
+        : L"Enter: select | Shift+Enter: cd parent | Tab: search contents | Esc: close";
     renderOverlayText(hint, hintBar.x, hintBar.y + 6, textDim, 0);
     if (!results.empty()) {
         std::wstring countStr = std::to_wstring(results.size()) + L" results";
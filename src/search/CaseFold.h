@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cwctype>
+#include <string>
+#include <string_view>
+
+// Per-UTF-16-unit case folding shared by the index builder, the folded name
+// pool in the index and query handling, so all of them agree on it. Only the
+// index build folds names; searches compare pre-folded text directly.
+class CaseFold {
+public:
+    static wchar_t fold(wchar_t c) {
+        if (c < 0x80) return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c | 0x20) : c;
+        return static_cast<wchar_t>(towlower(c));
+    }
+
+    static void foldInto(const wchar_t* src, size_t count, wchar_t* dst) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = fold(src[i]);
+        }
+    }
+
+    static std::wstring fold(std::wstring_view text) {
+        std::wstring out(text.size(), L'\0');
+        foldInto(text.data(), text.size(), out.data());
+        return out;
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "IndexFormat.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+struct JournalChange {
+    enum class Kind : uint8_t { Removed, Added };
+
+    Kind kind;
+    uint8_t driveIndex;
+    uint32_t attributes;
+    uint64_t fileRef;
+    uint64_t parentRef;
+    std::wstring name;  // Added only
+    uint64_t size = FileMetadata::UNKNOWN_SIZE;
+    uint32_t modifiedTime = FileMetadata::UNKNOWN_TIME;
+};
+
+// A feed of file system changes in the order they happened. The index
+// applies them to its delta as they arrive; positions() is saved with it
+// so the next session resumes where this one stopped.
+class ChangeJournalSource {
+public:
+    virtual ~ChangeJournalSource() = default;
+
+    // Appends every change recorded since the previous call. False when the
+    // history can't be followed any more (journal deleted, recreated or
+    // wrapped past our position) and the index has to be rebuilt.
+    virtual bool read(std::vector<JournalChange>& out, std::atomic<bool>& cancel) = 0;
+
+    virtual std::vector<DriveMetadata> positions() const = 0;
+};
+
+// Scripted feed for driving the index without a live volume, e.g. in tests
+// and benchmarks on any platform. Pushed changes are handed out by the next
+// read, each one advancing its drive's lastUsn by one.
+class ReplayJournalSource : public ChangeJournalSource {
+public:
+    explicit ReplayJournalSource(std::vector<DriveMetadata> positions = {})
+        : positions_(std::move(positions)) {}
+
+    void push(JournalChange change) {
+        std::lock_guard lock(mutex_);
+        pending_.push_back(std::move(change));
+    }
+
+    void push(std::vector<JournalChange> changes) {
+        std::lock_guard lock(mutex_);
+        for (auto& change : changes) {
+            pending_.push_back(std::move(change));
+        }
+    }
+
+    // the next read reports the journal as lost
+    void fail() {
+        std::lock_guard lock(mutex_);
+        failed_ = true;
+    }
+
+    bool read(std::vector<JournalChange>& out, std::atomic<bool>& cancel) override {
+        std::lock_guard lock(mutex_);
+        if (failed_) {
+            failed_ = false;
+            pending_.clear();
+            return false;
+        }
+
+        while (!pending_.empty() && !cancel) {
+            advance(pending_.front().driveIndex);
+            out.push_back(std::move(pending_.front()));
+            pending_.pop_front();
+        }
+        return true;
+    }
+
+    std::vector<DriveMetadata> positions() const override {
+        std::lock_guard lock(mutex_);
+        return positions_;
+    }
+
+private:
+    void advance(uint8_t driveIndex) {
+        wchar_t letter = static_cast<wchar_t>(L'A' + driveIndex);
+        for (auto& meta : positions_) {
+            if (meta.driveLetter == letter) {
+                meta.lastUsn++;
+                return;
+            }
+        }
+        DriveMetadata meta{};
+        meta.driveLetter = letter;
+        meta.lastUsn = 1;
+        positions_.push_back(meta);
+    }
+
+    mutable std::mutex mutex_;
+    std::deque<JournalChange> pending_;
+    std::vector<DriveMetadata> positions_;
+    bool failed_ = false;
+};
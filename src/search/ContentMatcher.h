@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Utf8.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <immintrin.h>
+#define VELOCITTY_SIMD_SSE2 1
+#endif
+
+// A literal looked for in file contents, line by line. Files are searched
+// as UTF-8 bytes: ASCII letters match either case, everything else only
+// exactly. Files that look binary, UTF-16 text among them, are skipped.
+//
+// Candidate positions come from comparing the literal's first and last
+// bytes against 16 positions at once; only where both agree are the bytes
+// between compared, so most of a file is read once, a vector at a time.
+class ContentMatcher {
+public:
+    struct LineMatch {
+        uint32_t line;        // 1-based
+        std::wstring text;    // the line, trimmed and cut to MAX_PREVIEW bytes around the match
+        uint32_t matchStart;  // in text
+        uint32_t matchLen;
+    };
+
+    explicit ContentMatcher(std::wstring_view literal) {
+        pattern_ = Utf8::encode(literal);
+        masks_.resize(pattern_.size());
+        for (size_t i = 0; i < pattern_.size(); ++i) {
+            char c = pattern_[i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c + ('a' - 'A'));
+            pattern_[i] = c;
+            // or-ing 0x20 folds an ASCII upper-case letter onto its lower case
+            masks_[i] = c >= 'a' && c <= 'z' ? 0x20 : 0;
+        }
+    }
+
+    bool empty() const { return pattern_.empty(); }
+
+    // Calls fn(const LineMatch&) for each line holding the literal, in file
+    // order, until it returns false. False if the file looks binary.
+    template <typename Fn>
+    bool forEachMatch(const uint8_t* data, size_t size, Fn&& fn) const {
+        if (pattern_.empty()) return true;
+        if (memchr(data, 0, std::min(size, BINARY_PROBE)) != nullptr) return false;
+
+        uint32_t line = 1;
+        size_t counted = 0;  // newlines before here are in line
+        size_t from = 0;
+        while (from < size) {
+            size_t pos = find(data, size, from);
+            if (pos == NOT_FOUND) break;
+
+            size_t lineStart = pos;
+            while (lineStart > from && data[lineStart - 1] != '\n') --lineStart;
+            auto* newline = static_cast<const uint8_t*>(memchr(data + pos, '\n', size - pos));
+            size_t lineEnd = newline ? static_cast<size_t>(newline - data) : size;
+
+            line += static_cast<uint32_t>(std::count(data + counted, data + lineStart, '\n'));
+            counted = lineStart;
+
+            if (!fn(preview(data, lineStart, lineEnd, pos, line))) break;
+            from = lineEnd + 1;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+    // a NUL this early means a binary file, as grep decides it
+    static constexpr size_t BINARY_PROBE = 8192;
+    static constexpr size_t MAX_PREVIEW = 160;
+
+    // first position at or after from where the literal starts
+    size_t find(const uint8_t* data, size_t size, size_t from) const {
+        const size_t n = pattern_.size();
+        if (size < n) return NOT_FOUND;
+        const size_t lastStart = size - n;
+        size_t i = from;
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        const __m128i firstMask = _mm_set1_epi8(masks_.front());
+        const __m128i firstByte = _mm_set1_epi8(pattern_.front());
+        const __m128i lastMask = _mm_set1_epi8(masks_.back());
+        const __m128i lastByte = _mm_set1_epi8(pattern_.back());
+
+        for (; i + 16 <= lastStart + 1; i += 16) {
+            __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + n - 1));
+            __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(head, firstMask), firstByte),
+                                       _mm_cmpeq_epi8(_mm_or_si128(tail, lastMask), lastByte));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+            while (mask) {
+                size_t pos = i + std::countr_zero(mask);
+                if (matchesAt(data, pos)) return pos;
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; i <= lastStart; ++i) {
+            if (static_cast<char>(data[i] | masks_.front()) == pattern_.front() && matchesAt(data, i)) return i;
+        }
+        return NOT_FOUND;
+    }
+
+    bool matchesAt(const uint8_t* data, size_t pos) const {
+        for (size_t k = 0; k < pattern_.size(); ++k) {
+            if (static_cast<char>(data[pos + k] | masks_[k]) != pattern_[k]) return false;
+        }
+        return true;
+    }
+
+    LineMatch preview(const uint8_t* data, size_t lineStart, size_t lineEnd, size_t pos, uint32_t line) const {
+        const size_t matchEnd = pos + pattern_.size();
+        auto blank = [](uint8_t c) { return c == ' ' || c == '\t' || c == '\r'; };
+        while (lineEnd > matchEnd && blank(data[lineEnd - 1])) --lineEnd;
+        while (lineStart < pos && blank(data[lineStart])) ++lineStart;
+
+        // long lines keep some context before the match and fill the rest after
+        size_t start = lineStart;
+        size_t end = lineEnd;
+        if (end - start > MAX_PREVIEW) {
+            start = std::max(lineStart, pos > MAX_PREVIEW / 4 ? pos - MAX_PREVIEW / 4 : 0);
+            end = std::min(lineEnd, std::max(matchEnd, start + MAX_PREVIEW));
+            while (start < pos && (data[start] & 0xC0) == 0x80) ++start;  // don't start mid-character
+            while (end > matchEnd && end < lineEnd && (data[end] & 0xC0) == 0x80) --end;
+        }
+
+        LineMatch m;
+        m.line = line;
+        auto bytes = [&](size_t a, size_t b) {
+            return std::string_view(reinterpret_cast<const char*>(data) + a, b - a);
+        };
+        if (start > lineStart) m.text = L"...";
+        m.text += Utf8::decode(bytes(start, pos));
+        m.matchStart = static_cast<uint32_t>(m.text.size());
+        m.text += Utf8::decode(bytes(pos, matchEnd));
+        m.matchLen = static_cast<uint32_t>(m.text.size()) - m.matchStart;
+        m.text += Utf8::decode(bytes(matchEnd, end));
+        if (end < lineEnd) m.text += L"...";
+
+        std::replace(m.text.begin(), m.text.end(), L'\t', L' ');
+        return m;
+    }
+
+    std::string pattern_;  // ASCII letters in lower case
+    std::string masks_;    // 0x20 where pattern_ has a letter
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "IndexFormat.h"
+#include "CaseFold.h"
+#include "MappedFile.h"
+#include <string_view>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+// Changes layered over a base index without rewriting it. Added entries
+// continue the base's index space (base entry count + local index) and
+// tombstones hide entries that no longer exist, whether base or added.
+// Both stay small between compactions, so the whole segment is read into
+// memory and rewritten on every update.
+class DeltaSegment {
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;  // same as DiskIndex::NO_PARENT
+
+    static std::wstring pathFor(const std::wstring& indexPath) {
+        return indexPath + L".delta";
+    }
+
+    void reset(uint64_t baseTimestamp, uint32_t baseEntryCount) {
+        baseTimestamp_ = baseTimestamp;
+        baseEntryCount_ = baseEntryCount;
+        entries_.clear();
+        parents_.clear();
+        sizes_.clear();
+        modifiedTimes_.clear();
+        stringPool_.clear();
+        foldedPool_.clear();
+        tombstones_.clear();
+        driveMetadata_.clear();
+        latestByRef_.clear();
+    }
+
+    // Leaves the segment empty when the file is missing, damaged or was
+    // written against a different base.
+    bool load(const std::wstring& path, uint64_t baseTimestamp, uint32_t baseEntryCount) {
+        reset(baseTimestamp, baseEntryCount);
+
+        MappedFile file;
+        if (!file.open(path, MappedFile::Access::Sequential)) return false;
+
+        const uint8_t* ptr = file.data();
+        size_t left = file.size();
+        auto read = [&](void* data, size_t bytes) {
+            if (bytes > left) return false;
+            if (bytes) memcpy(data, ptr, bytes);
+            ptr += bytes;
+            left -= bytes;
+            return true;
+        };
+
+        DeltaSegmentHeader header{};
+        bool ok = read(&header, sizeof(header)) &&
+                  header.magic == DeltaSegmentHeader::MAGIC &&
+                  header.version == DeltaSegmentHeader::VERSION &&
+                  header.baseTimestamp == baseTimestamp &&
+                  header.baseEntryCount == baseEntryCount;
+
+        // every section must fit what's left before anything is sized by it
+        ok = ok && uint64_t(header.addedCount) * (sizeof(DiskFileEntry) + sizeof(uint32_t) * 2 +
+                                                  sizeof(uint64_t)) +
+                   uint64_t(header.stringPoolSize) * sizeof(DiskChar) +
+                   uint64_t(header.tombstoneCount) * sizeof(uint32_t) +
+                   uint64_t(header.metaCount) * sizeof(DriveMetadata) <= left;
+
+        if (ok) {
+            entries_.resize(header.addedCount);
+            parents_.resize(header.addedCount);
+            sizes_.resize(header.addedCount);
+            modifiedTimes_.resize(header.addedCount);
+            stringPool_.resize(header.stringPoolSize);
+            tombstones_.resize(header.tombstoneCount);
+            driveMetadata_.resize(header.metaCount);
+
+            read(entries_.data(), entries_.size() * sizeof(DiskFileEntry));
+            read(parents_.data(), parents_.size() * sizeof(uint32_t));
+            read(sizes_.data(), sizes_.size() * sizeof(uint64_t));
+            read(modifiedTimes_.data(), modifiedTimes_.size() * sizeof(uint32_t));
+            auto pool = reinterpret_cast<const DiskChar*>(ptr);
+            std::copy(pool, pool + stringPool_.size(), stringPool_.begin());
+            ptr += stringPool_.size() * sizeof(DiskChar);
+            left -= stringPool_.size() * sizeof(DiskChar);
+            read(tombstones_.data(), tombstones_.size() * sizeof(uint32_t));
+            read(driveMetadata_.data(), driveMetadata_.size() * sizeof(DriveMetadata));
+            ok = valid();
+        }
+
+        if (!ok) {
+            reset(baseTimestamp, baseEntryCount);
+            return false;
+        }
+
+        foldedPool_.resize(stringPool_.size());
+        CaseFold::foldInto(stringPool_.data(), stringPool_.size(), foldedPool_.data());
+
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            latestByRef_[refKeyOf(entries_[i])] = baseEntryCount_ + i;
+        }
+        return true;
+    }
+
+    bool save(const std::wstring& path) const {
+        DeltaSegmentHeader header{};
+        header.magic = DeltaSegmentHeader::MAGIC;
+        header.version = DeltaSegmentHeader::VERSION;
+        header.baseTimestamp = baseTimestamp_;
+        header.baseEntryCount = baseEntryCount_;
+        header.addedCount = static_cast<uint32_t>(entries_.size());
+        header.stringPoolSize = static_cast<uint32_t>(stringPool_.size());
+        header.tombstoneCount = static_cast<uint32_t>(tombstones_.size());
+        header.metaCount = static_cast<uint32_t>(driveMetadata_.size());
+
+        std::wstring tempPath = path + L".tmp";
+
+        FileWriter out;
+        if (!out.create(tempPath)) return false;
+
+        out.write(&header, sizeof(header));
+        out.write(entries_.data(), entries_.size() * sizeof(DiskFileEntry));
+        out.write(parents_.data(), parents_.size() * sizeof(uint32_t));
+        out.write(sizes_.data(), sizes_.size() * sizeof(uint64_t));
+        out.write(modifiedTimes_.data(), modifiedTimes_.size() * sizeof(uint32_t));
+        out.writeChars(stringPool_.data(), stringPool_.size());
+        out.write(tombstones_.data(), tombstones_.size() * sizeof(uint32_t));
+        out.write(driveMetadata_.data(), driveMetadata_.size() * sizeof(DriveMetadata));
+
+        if (!out.close() || !FileWriter::replace(tempPath, path)) {
+            FileWriter::remove(tempPath);
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t baseEntryCount() const { return baseEntryCount_; }
+    uint32_t addedCount() const { return static_cast<uint32_t>(entries_.size()); }
+    uint32_t tombstoneCount() const { return static_cast<uint32_t>(tombstones_.size()); }
+    size_t changeCount() const { return entries_.size() + tombstones_.size(); }
+    bool empty() const { return changeCount() == 0; }
+
+    // local = index - baseEntryCount()
+    const DiskFileEntry& entry(uint32_t local) const { return entries_[local]; }
+
+    std::wstring_view name(uint32_t local) const {
+        const auto& e = entries_[local];
+        return { stringPool_.data() + e.nameOffset, e.nameLength };
+    }
+
+    std::wstring_view foldedName(uint32_t local) const {
+        const auto& e = entries_[local];
+        return { foldedPool_.data() + e.nameOffset, e.nameLength };
+    }
+
+    uint32_t parent(uint32_t local) const { return parents_[local]; }
+    uint64_t fileSize(uint32_t local) const { return sizes_[local]; }
+    uint32_t modifiedTime(uint32_t local) const { return modifiedTimes_[local]; }
+
+    // Appends an entry (its nameOffset is ignored) and returns its index.
+    uint32_t add(const DiskFileEntry& entry, std::wstring_view name, uint32_t parent,
+                 uint64_t size = FileMetadata::UNKNOWN_SIZE, uint32_t modifiedTime = FileMetadata::UNKNOWN_TIME) {
+        uint16_t nameLen = static_cast<uint16_t>(std::min(name.length(), size_t(UINT16_MAX)));
+
+        DiskFileEntry e = entry;
+        e.nameOffset = static_cast<uint32_t>(stringPool_.size());
+        e.nameLength = nameLen;
+        stringPool_.insert(stringPool_.end(), name.begin(), name.begin() + nameLen);
+        for (uint16_t i = 0; i < nameLen; ++i) {
+            foldedPool_.push_back(CaseFold::fold(name[i]));
+        }
+
+        uint32_t idx = baseEntryCount_ + static_cast<uint32_t>(entries_.size());
+        entries_.push_back(e);
+        parents_.push_back(parent);
+        sizes_.push_back(size);
+        modifiedTimes_.push_back(modifiedTime);
+        latestByRef_[refKeyOf(e)] = idx;
+        return idx;
+    }
+
+    // false if idx was already tombstoned
+    bool tombstone(uint32_t idx) {
+        auto it = std::lower_bound(tombstones_.begin(), tombstones_.end(), idx);
+        if (it != tombstones_.end() && *it == idx) return false;
+        tombstones_.insert(it, idx);
+        return true;
+    }
+
+    bool isTombstoned(uint32_t idx) const {
+        return std::binary_search(tombstones_.begin(), tombstones_.end(), idx);
+    }
+
+    const std::vector<uint32_t>& tombstones() const { return tombstones_; }
+
+    // most recently added entry for a (drive, fileRef) key, tombstoned or not
+    uint32_t findAdded(uint64_t refKey) const {
+        auto it = latestByRef_.find(refKey);
+        return it != latestByRef_.end() ? it->second : NOT_FOUND;
+    }
+
+    const std::vector<DriveMetadata>& driveMetadata() const { return driveMetadata_; }
+    void setDriveMetadata(std::vector<DriveMetadata> meta) { driveMetadata_ = std::move(meta); }
+
+private:
+    // Every name inside the pool, every parent and tombstone inside the
+    // combined index space, and tombstones sorted for binary searches, so
+    // nothing read from a damaged file is used to index past the end.
+    bool valid() const {
+        const uint64_t total = uint64_t(baseEntryCount_) + entries_.size();
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            if (uint64_t(entries_[i].nameOffset) + entries_[i].nameLength > stringPool_.size()) return false;
+            if (parents_[i] != NO_PARENT && parents_[i] >= total) return false;
+        }
+        for (size_t i = 0; i < tombstones_.size(); ++i) {
+            if (tombstones_[i] >= total || (i > 0 && tombstones_[i] <= tombstones_[i - 1])) return false;
+        }
+        return true;
+    }
+
+    static uint64_t refKeyOf(const DiskFileEntry& e) {
+        return (static_cast<uint64_t>(e.driveIndex) << 56) | (e.fileRef & 0x00FFFFFFFFFFFFFFULL);
+    }
+
+    uint64_t baseTimestamp_ = 0;
+    uint32_t baseEntryCount_ = 0;
+    std::vector<DiskFileEntry> entries_;
+    std::vector<uint32_t> parents_;
+    std::vector<uint64_t> sizes_;
+    std::vector<uint32_t> modifiedTimes_;
+    std::vector<wchar_t> stringPool_;
+    std::vector<wchar_t> foldedPool_;  // in memory only, rebuilt on load
+    std::vector<uint32_t> tombstones_;
+    std::vector<DriveMetadata> driveMetadata_;
+    std::unordered_map<uint64_t, uint32_t> latestByRef_;
+};
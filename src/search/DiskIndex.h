@@ -1,44 +1,27 @@
 #pragma once
 
-#include "../../framework.h"
-#include <span>
+#include "IndexFormat.h"
+#include "ChangeJournal.h"
+#include "DeltaSegment.h"
+#include "CaseFold.h"
+#include "MappedFile.h"
+#include "PostingList.h"
 #include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include "../../framework.h"
 #include <ShlObj.h>
-
-#pragma pack(push, 1)
-struct DiskIndexHeader {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t entryCount;
-    uint32_t stringPoolSize;
-    uint32_t trigramCount;
-    uint32_t postingDataSize;
-    uint64_t buildTimestamp;
-    uint32_t reserved[4];
-
-    static constexpr uint32_t MAGIC = 0x56454C49;  // "VELI"
-    static constexpr uint32_t VERSION = 2;  // v2: multi-drive composite keys
-};
-
-struct DiskFileEntry {
-    uint64_t fileRef;
-    uint64_t parentRef;
-    uint32_t nameOffset;
-    uint16_t nameLength;
-    uint8_t attributes;
-    uint8_t driveIndex;
-};
-
-struct DiskTrigramEntry {
-    uint32_t trigram;
-    uint32_t postingOffset;
-    uint32_t postingCount;
-};
-#pragma pack(pop)
-
-static_assert(sizeof(DiskIndexHeader) == 48, "DiskIndexHeader size mismatch");
-static_assert(sizeof(DiskFileEntry) == 24, "DiskFileEntry size mismatch");
-static_assert(sizeof(DiskTrigramEntry) == 12, "DiskTrigramEntry size mismatch");
+#else
+#include "Utf8.h"
+#include <cstdlib>
+#include <sys/stat.h>
+#endif
 
 class DiskIndex {
 public:
@@ -60,102 +43,317 @@ public:
     bool open(const std::wstring& path) {
         close();
 
-        hFile_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
-                             nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-        if (hFile_ == INVALID_HANDLE_VALUE) return false;
+        if (!file_.open(path)) return false;
 
-        LARGE_INTEGER size;
-        if (!GetFileSizeEx(hFile_, &size)) {
+        const uint8_t* base = file_.data();
+        const uint8_t* end = base + file_.size();
+        if (file_.size() < sizeof(DiskIndexHeader)) {
             close();
             return false;
         }
-        fileSize_ = static_cast<size_t>(size.QuadPart);
 
-        if (fileSize_ < sizeof(DiskIndexHeader)) {
+        header_ = reinterpret_cast<const DiskIndexHeader*>(base);
+        if (header_->magic != DiskIndexHeader::MAGIC ||
+            header_->version != DiskIndexHeader::VERSION) {
             close();
             return false;
         }
 
-        hMapping_ = CreateFileMappingW(hFile_, nullptr, PAGE_READONLY, 0, 0, nullptr);
-        if (!hMapping_) {
+        // sections are laid out back to back; a truncated file fails here.
+        // Offsets and indices inside the sections are checked where they are
+        // read, so opening doesn't touch every entry.
+        const uint8_t* ptr = base + sizeof(DiskIndexHeader);
+        auto take = [&](uint64_t count, size_t elementSize) -> const uint8_t* {
+            if (!ptr || count * elementSize > static_cast<uint64_t>(end - ptr)) {
+                ptr = nullptr;
+                return nullptr;
+            }
+            const uint8_t* section = ptr;
+            ptr += count * elementSize;
+            return section;
+        };
+
+        uint32_t count = header_->entryCount;
+        entries_ = reinterpret_cast<const DiskFileEntry*>(take(count, sizeof(DiskFileEntry)));
+        fileSizes_ = reinterpret_cast<const uint64_t*>(take(count, sizeof(uint64_t)));
+        parentIndex_ = reinterpret_cast<const uint32_t*>(take(count, sizeof(uint32_t)));
+        subtreeEnd_ = reinterpret_cast<const uint32_t*>(take(count, sizeof(uint32_t)));
+        refOrder_ = reinterpret_cast<const uint32_t*>(take(count, sizeof(uint32_t)));
+        modifiedTimes_ = reinterpret_cast<const uint32_t*>(take(count, sizeof(uint32_t)));
+        extensionIds_ = reinterpret_cast<const uint16_t*>(take(count + (count & 1), sizeof(uint16_t)));
+        auto pools = reinterpret_cast<const DiskChar*>(take(header_->stringPoolSize * 2ull, sizeof(DiskChar)));
+        extensionOffsets_ = reinterpret_cast<const uint32_t*>(take(header_->extensionCount + 1ull, sizeof(uint32_t)));
+        extensionPool_ = reinterpret_cast<const DiskChar*>(
+            take(header_->extensionPoolSize + (header_->extensionPoolSize & 1), sizeof(DiskChar)));
+
+        const uint8_t* postingsStart = ptr;
+        trigrams_ = reinterpret_cast<const DiskTrigramEntry*>(take(header_->trigramCount, sizeof(DiskTrigramEntry)));
+        postingBlocks_ = reinterpret_cast<const DiskPostingBlock*>(take(header_->postingBlockCount, sizeof(DiskPostingBlock)));
+        postingData_ = reinterpret_cast<const uint32_t*>(take(header_->postingDataSize, sizeof(uint32_t)));
+        if (!ptr || extensionOffsets_[header_->extensionCount] > header_->extensionPoolSize) {
             close();
             return false;
         }
 
-        base_ = MapViewOfFile(hMapping_, FILE_MAP_READ, 0, 0, 0);
-        if (!base_) {
-            close();
-            return false;
+        // names and entries are scanned front to back; postings are probed
+        file_.advise(postingsStart - base, ptr - postingsStart, MappedFile::Access::Random);
+
+        if constexpr (sizeof(wchar_t) == sizeof(DiskChar)) {
+            stringPool_ = reinterpret_cast<const wchar_t*>(pools);
+        } else {
+            // left unwritten, so only the chunks names are read from get pages
+            uint64_t chars = header_->stringPoolSize * 2ull;
+            widePools_ = std::make_unique<WidePools>();
+            widePools_->source = pools;
+            widePools_->chars = std::make_unique_for_overwrite<wchar_t[]>(chars);
+            widePools_->ready = std::make_unique<std::atomic<bool>[]>((chars + WIDE_CHUNK - 1) / WIDE_CHUNK);
+            stringPool_ = widePools_->chars.get();
         }
-
-        header_ = static_cast<const DiskIndexHeader*>(base_);
-        if (header_->magic != DiskIndexHeader::MAGIC ||
-            header_->version != DiskIndexHeader::VERSION) {
-            close();
-            return false;
+        foldedPool_ = stringPool_ + header_->stringPoolSize;
+
+        if (ptr + sizeof(uint32_t) <= end) {
+            uint32_t metaCount;
+            memcpy(&metaCount, ptr, sizeof(metaCount));
+            ptr += sizeof(uint32_t);
+            if (metaCount <= static_cast<size_t>(end - ptr) / sizeof(DriveMetadata)) {
+                driveMetadata_ = reinterpret_cast<const DriveMetadata*>(ptr);
+                metaCount_ = metaCount;
+            }
         }
 
-        auto ptr = static_cast<const uint8_t*>(base_) + sizeof(DiskIndexHeader);
-
-        entries_ = reinterpret_cast<const DiskFileEntry*>(ptr);
-        ptr += header_->entryCount * sizeof(DiskFileEntry);
-
-        stringPool_ = reinterpret_cast<const wchar_t*>(ptr);
-        ptr += header_->stringPoolSize * sizeof(wchar_t);
-
-        trigrams_ = reinterpret_cast<const DiskTrigramEntry*>(ptr);
-        ptr += header_->trigramCount * sizeof(DiskTrigramEntry);
-
-        postingData_ = reinterpret_cast<const uint32_t*>(ptr);
-
-        refToIndex_.reserve(header_->entryCount);
-        for (uint32_t i = 0; i < header_->entryCount; ++i) {
-            uint64_t key = makeRefKey(entries_[i].driveIndex, entries_[i].fileRef);
-            refToIndex_[key] = i;
-        }
+        loadDelta(DeltaSegment::pathFor(path));
 
         return true;
     }
 
     void close() {
-        refToIndex_.clear();
         header_ = nullptr;
         entries_ = nullptr;
+        fileSizes_ = nullptr;
+        parentIndex_ = nullptr;
+        subtreeEnd_ = nullptr;
+        refOrder_ = nullptr;
+        modifiedTimes_ = nullptr;
+        extensionIds_ = nullptr;
+        extensionOffsets_ = nullptr;
+        extensionPool_ = nullptr;
         stringPool_ = nullptr;
+        foldedPool_ = nullptr;
         trigrams_ = nullptr;
+        postingBlocks_ = nullptr;
         postingData_ = nullptr;
-
-        if (base_) {
-            UnmapViewOfFile(base_);
-            base_ = nullptr;
-        }
-        if (hMapping_) {
-            CloseHandle(hMapping_);
-            hMapping_ = nullptr;
-        }
-        if (hFile_ != INVALID_HANDLE_VALUE) {
-            CloseHandle(hFile_);
-            hFile_ = INVALID_HANDLE_VALUE;
-        }
-        fileSize_ = 0;
+        driveMetadata_ = nullptr;
+        metaCount_ = 0;
+        widePools_.reset();
+        addedExtensions_.clear();
+        deltaExtensionIds_.clear();
+        delta_.reset(0, 0);
+        deadBits_.clear();
+        file_.close();
     }
 
-    bool isOpen() const { return base_ != nullptr; }
+    bool isOpen() const { return file_.isOpen(); }
 
+    // Entries live in one index space: the base file's entries first, then
+    // the ones added by the delta segment since the last compaction.
     uint32_t entryCount() const {
+        return baseEntryCount() + delta_.addedCount();
+    }
+
+    uint32_t baseEntryCount() const {
         return header_ ? header_->entryCount : 0;
     }
 
     const DiskFileEntry& entry(uint32_t idx) const {
-        return entries_[idx];
+        return idx < header_->entryCount ? entries_[idx] : delta_.entry(idx - header_->entryCount);
     }
 
+    // empty for a name that runs past the pool in a damaged index
     std::wstring_view getName(uint32_t idx) const {
+        if (idx >= header_->entryCount) return delta_.name(idx - header_->entryCount);
         const auto& e = entries_[idx];
+        if (uint64_t(e.nameOffset) + e.nameLength > header_->stringPoolSize) return {};
+        widen(e.nameOffset, e.nameLength);
         return { stringPool_ + e.nameOffset, e.nameLength };
     }
 
-    std::span<const uint32_t> getPostings(uint32_t trigram) const {
+    // the name passed through CaseFold, for case-insensitive matching
+    std::wstring_view getFoldedName(uint32_t idx) const {
+        if (idx >= header_->entryCount) return delta_.foldedName(idx - header_->entryCount);
+        const auto& e = entries_[idx];
+        if (uint64_t(e.nameOffset) + e.nameLength > header_->stringPoolSize) return {};
+        widen(uint64_t(header_->stringPoolSize) + e.nameOffset, e.nameLength);
+        return { foldedPool_ + e.nameOffset, e.nameLength };
+    }
+
+    // tombstoned by the delta segment (or a zeroed legacy entry)
+    bool isDeleted(uint32_t idx) const {
+        if ((idx >> 6) < deadBits_.size() && (deadBits_[idx >> 6] >> (idx & 63)) & 1) return true;
+        return entry(idx).fileRef == 0;
+    }
+
+    // FileMetadata::UNKNOWN_SIZE for directories and sizes the source didn't report
+    uint64_t fileSize(uint32_t idx) const {
+        return idx < header_->entryCount ? fileSizes_[idx] : delta_.fileSize(idx - header_->entryCount);
+    }
+
+    // FileMetadata::UNKNOWN_TIME if the source didn't report it
+    uint32_t modifiedTime(uint32_t idx) const {
+        return idx < header_->entryCount ? modifiedTimes_[idx] : delta_.modifiedTime(idx - header_->entryCount);
+    }
+
+    uint16_t extensionId(uint32_t idx) const {
+        return idx < header_->entryCount ? extensionIds_[idx] : deltaExtensionIds_[idx - header_->entryCount];
+    }
+
+    // The base entries' columns, for scans that want them without the
+    // per-entry base/delta check.
+    const uint64_t* fileSizeColumn() const { return fileSizes_; }
+    const uint32_t* modifiedTimeColumn() const { return modifiedTimes_; }
+    const uint16_t* extensionIdColumn() const { return extensionIds_; }
+
+    // Id of a folded extension, or NOT_FOUND if no entry has it; entries
+    // added since the last compaction may bring extensions the base lacks.
+    uint32_t findExtension(std::wstring_view folded) const {
+        if (!header_) return NOT_FOUND;
+
+        uint32_t lo = 0;
+        uint32_t hi = header_->extensionCount;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = compareExtension(mid, folded);
+            if (cmp == 0) return mid;
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        auto it = addedExtensions_.find(std::wstring(folded));
+        return it != addedExtensions_.end() ? it->second : NOT_FOUND;
+    }
+
+    // ids [0, extensionCount()) are in use, OTHER_EXTENSION aside
+    uint32_t extensionCount() const {
+        return (header_ ? header_->extensionCount : 0) + static_cast<uint32_t>(addedExtensions_.size());
+    }
+
+    // NO_PARENT for volume roots and entries whose parent wasn't indexed
+    uint32_t parentOf(uint32_t idx) const {
+        uint32_t parent = idx < header_->entryCount ? parentIndex_[idx]
+                                                    : delta_.parent(idx - header_->entryCount);
+        if (parent >= entryCount()) return NO_PARENT;
+        if (!isDeleted(parent)) return parent;
+
+        // a renamed or moved directory is tombstoned and re-added under the
+        // same ref; its children still point at the old entry until compaction
+        const auto& p = entry(parent);
+        uint32_t moved = delta_.findAdded(makeRefKey(p.driveIndex, p.fileRef));
+        if (moved != DeltaSegment::NOT_FOUND && !isDeleted(moved)) return moved;
+        return parent;
+    }
+
+    // Base entries are stored in depth-first pre-order, so a base entry's
+    // descendants are exactly [idx + 1, subtreeEnd(idx)). Entries added in
+    // the delta aren't covered; their ancestry is only known via parentOf.
+    // An end outside (idx, baseEntryCount()] reads as no descendants.
+    uint32_t subtreeEnd(uint32_t idx) const {
+        uint32_t end = subtreeEnd_[idx];
+        return end > idx && end <= header_->entryCount ? end : idx + 1;
+    }
+
+    // Base entry for a (drive, fileRef) key via the ref-ordered column, or
+    // NOT_FOUND. Delta entries are looked up through delta().findAdded.
+    uint32_t findBaseEntry(uint64_t refKey) const {
+        if (!header_) return NOT_FOUND;
+
+        // an out-of-range slot in a damaged index sorts last and never matches
+        const uint32_t count = header_->entryCount;
+        const uint32_t* last = refOrder_ + count;
+        const uint32_t* it = std::partition_point(refOrder_, last, [&](uint32_t i) {
+            return i < count && makeRefKey(entries_[i].driveIndex, entries_[i].fileRef) < refKey;
+        });
+        if (it != last && *it < count && makeRefKey(entries_[*it].driveIndex, entries_[*it].fileRef) == refKey) {
+            return *it;
+        }
+        return NOT_FOUND;
+    }
+
+    // Newest live entry for a (drive, fileRef) key, base or delta, or NOT_FOUND.
+    uint32_t findByRef(uint64_t refKey) const {
+        uint32_t idx = delta_.findAdded(refKey);
+        if (idx != DeltaSegment::NOT_FOUND && !isDeleted(idx)) return idx;
+
+        idx = findBaseEntry(refKey);
+        if (idx != NOT_FOUND && !isDeleted(idx)) return idx;
+
+        return NOT_FOUND;
+    }
+
+    struct ApplyStats {
+        uint32_t added = 0;
+        uint32_t removed = 0;
+    };
+
+    // Applies journal changes, in order, to the in-memory delta; searches
+    // see them right away. Persisting is up to the caller (delta().save).
+    ApplyStats applyChanges(const std::vector<JournalChange>& changes) {
+        ApplyStats stats;
+        if (!header_) return stats;
+
+        for (const auto& change : changes) {
+            uint64_t key = makeRefKey(change.driveIndex, change.fileRef);
+            uint32_t existing = findByRef(key);
+
+            if (change.kind == JournalChange::Kind::Removed) {
+                if (existing != NOT_FOUND && delta_.tombstone(existing)) {
+                    markDeleted(existing);
+                    stats.removed++;
+                }
+                continue;
+            }
+
+            uint32_t parent = findByRef(makeRefKey(change.driveIndex, change.parentRef));
+            if (parent == NOT_FOUND) parent = NO_PARENT;
+
+            // a file reported again while open, with nothing changed
+            if (existing != NOT_FOUND && parentOf(existing) == parent &&
+                getName(existing) == std::wstring_view(change.name)) {
+                continue;
+            }
+
+            // a create for a ref that is still live replaces it
+            if (existing != NOT_FOUND && delta_.tombstone(existing)) {
+                markDeleted(existing);
+            }
+
+            DiskFileEntry e{};
+            e.fileRef = change.fileRef;
+            e.parentRef = change.parentRef;
+            e.attributes = static_cast<uint8_t>(change.attributes);
+            e.driveIndex = change.driveIndex;
+            delta_.add(e, change.name, parent, change.size, change.modifiedTime);
+            deltaExtensionIds_.push_back(internExtension(change.name));
+            stats.added++;
+        }
+        return stats;
+    }
+
+    // journal positions the delta is current to, saved along with it
+    void recordPositions(std::vector<DriveMetadata> positions) {
+        delta_.setDriveMetadata(std::move(positions));
+    }
+
+    const DeltaSegment& delta() const { return delta_; }
+
+    // journal positions the index (including its delta) is current to
+    std::vector<DriveMetadata> driveMetadata() const {
+        if (!delta_.driveMetadata().empty()) return delta_.driveMetadata();
+        return { driveMetadata_, driveMetadata_ + metaCount_ };
+    }
+
+    PostingList getPostings(uint32_t trigram) const {
         if (!header_ || header_->trigramCount == 0) return {};
 
         int lo = 0;
@@ -165,10 +363,7 @@ public:
             int mid = lo + (hi - lo) / 2;
             uint32_t midTri = trigrams_[mid].trigram;
 
-            if (midTri == trigram) {
-                return { postingData_ + trigrams_[mid].postingOffset,
-                         trigrams_[mid].postingCount };
-            }
+            if (midTri == trigram) return postingsOf(trigrams_[mid]);
             if (midTri < trigram) {
                 lo = mid + 1;
             } else {
@@ -178,45 +373,62 @@ public:
         return {};
     }
 
-    std::vector<uint32_t> getShortNameIndices() const {
-        // trigram 0 is reserved for short names (< 3 chars)
-        auto span = getPostings(0);
-        return { span.begin(), span.end() };
+    // Every list keyed within [first, last], e.g. all bigrams ending in one char.
+    std::vector<PostingList> getPostingsInRange(uint32_t first, uint32_t last) const {
+        std::vector<PostingList> lists;
+        if (!header_) return lists;
+
+        const DiskTrigramEntry* end = trigrams_ + header_->trigramCount;
+        const DiskTrigramEntry* it = std::partition_point(trigrams_, end,
+            [first](const DiskTrigramEntry& t) { return t.trigram < first; });
+
+        for (; it != end && it->trigram <= last; ++it) {
+            PostingList list = postingsOf(*it);
+            if (!list.empty()) lists.push_back(list);
+        }
+        return lists;
+    }
+
+    // Lists that together hold every base entry whose folded name contains
+    // the folded char c: its first-char bucket and each bigram ending in c.
+    std::vector<PostingList> getCharPostings(wchar_t c) const {
+        auto lists = getPostingsInRange(makeBigram(0, c), makeBigram(0xFFFF, c));
+        auto bucket = getPostings(makeFirstCharKey(c));
+        if (!bucket.empty()) lists.push_back(bucket);
+        return lists;
     }
 
     std::wstring buildFullPath(uint32_t entryIndex) const {
-        if (!header_ || entryIndex >= header_->entryCount) return {};
+        if (!header_ || entryIndex >= entryCount()) return {};
 
         std::vector<std::wstring_view> parts;
         parts.reserve(32);
 
-        uint8_t driveIndex = entries_[entryIndex].driveIndex;
         uint32_t current = entryIndex;
 
-        while (current < header_->entryCount) {
-            const auto& e = entries_[current];
+        while (current < entryCount() && parts.size() < MAX_PATH_DEPTH) {
             auto name = getName(current);
             if (name.empty()) break;
 
             parts.push_back(name);
-
-            uint64_t parentKey = makeRefKey(driveIndex, e.parentRef);
-            auto it = refToIndex_.find(parentKey);
-            if (it == refToIndex_.end()) break;
-            current = it->second;
+            current = parentOf(current);
         }
 
         if (parts.empty()) return {};
 
-        wchar_t drive = L'A' + driveIndex;
-
         std::wstring path;
         path.reserve(256);
-        path += drive;
+#ifdef _WIN32
+        path += static_cast<wchar_t>(L'A' + entry(entryIndex).driveIndex);
         path += L':';
+        constexpr wchar_t SEPARATOR = L'\\';
+#else
+        // top-level entries of other mounts are named by their mount point
+        constexpr wchar_t SEPARATOR = L'/';
+#endif
 
         for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
-            path += L'\\';
+            path += SEPARATOR;
             path += *it;
         }
 
@@ -228,6 +440,7 @@ public:
     }
 
     static std::wstring getIndexPath() {
+#ifdef _WIN32
         wchar_t path[MAX_PATH];
         if (SUCCEEDED(SHGetFolderPathW(nullptr, CSIDL_LOCAL_APPDATA, nullptr, 0, path))) {
             std::wstring indexPath = path;
@@ -236,43 +449,223 @@ public:
             indexPath += L"\\search.idx";
             return indexPath;
         }
+#else
+        // $XDG_CACHE_HOME, falling back to ~/.cache as the spec says
+        std::string dir;
+        if (const char* cache = getenv("XDG_CACHE_HOME"); cache && *cache) {
+            dir = cache;
+        } else if (const char* home = getenv("HOME"); home && *home) {
+            dir = std::string(home) + "/.cache";
+        }
+        if (!dir.empty()) {
+            mkdir(dir.c_str(), 0700);
+            dir += "/velocitty";
+            mkdir(dir.c_str(), 0700);
+            return Utf8::decode(dir + "/search.idx");
+        }
+#endif
         return L"search.idx";
     }
 
+    // Key for three already folded chars. Below U+0400 (Latin, Greek, ...)
+    // they pack exactly into 10 bits each; any other trigram is hashed into
+    // the upper half of the key space, so it never aliases a packed one.
     static uint32_t makeTrigram(wchar_t a, wchar_t b, wchar_t c) {
-        return (static_cast<uint32_t>(towlower(a)) & 0x3FF) |
-               ((static_cast<uint32_t>(towlower(b)) & 0x3FF) << 10) |
-               ((static_cast<uint32_t>(towlower(c)) & 0x3FF) << 20);
+        uint32_t ua = static_cast<uint16_t>(a);
+        uint32_t ub = static_cast<uint16_t>(b);
+        uint32_t uc = static_cast<uint16_t>(c);
+        if ((ua | ub | uc) < 0x400) {
+            return ua | (ub << 10) | (uc << 20);
+        }
+        uint64_t h = ((static_cast<uint64_t>(ua) << 32) | (ub << 16) | uc) * 0x9E3779B97F4A7C15ULL;
+        return WIDE_TRIGRAM_TAG | static_cast<uint32_t>(h >> 34);
+    }
+
+    // Keys for 1-2 char queries sit above every trigram key. The second char
+    // of a bigram is the high half, so all bigrams ending in one char form a
+    // contiguous range; chars past 14 bits share keys, which only widens the
+    // candidates that matching checks anyway.
+    static uint32_t makeBigram(wchar_t a, wchar_t b) {
+        return BIGRAM_TAG | ((static_cast<uint32_t>(b) & 0x3FFF) << 16) | static_cast<uint16_t>(a);
+    }
+
+    static uint32_t makeFirstCharKey(wchar_t c) {
+        return FIRST_CHAR_TAG | static_cast<uint16_t>(c);
     }
 
     static uint64_t makeRefKey(uint8_t driveIndex, uint64_t fileRef) {
         return (static_cast<uint64_t>(driveIndex) << 56) | (fileRef & 0x00FFFFFFFFFFFFFFULL);
     }
 
+    // What follows the last dot of a name, unless that is the first or last
+    // char ("readme", ".gitignore" and "notes." have none) or it is longer
+    // than FileMetadata::MAX_EXTENSION_LENGTH.
+    static std::wstring_view extensionOf(std::wstring_view name) {
+        size_t dot = name.find_last_of(L'.');
+        if (dot == std::wstring_view::npos || dot == 0 || dot + 1 == name.size() ||
+            name.size() - dot - 1 > FileMetadata::MAX_EXTENSION_LENGTH) {
+            return {};
+        }
+        return name.substr(dot + 1);
+    }
+
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+    static constexpr uint32_t WIDE_TRIGRAM_TAG = 0x40000000;
+    static constexpr uint32_t BIGRAM_TAG = 0x80000000;
+    static constexpr uint32_t FIRST_CHAR_TAG = 0xC0000000;
+
 private:
+    // guards against parent cycles in a damaged index
+    static constexpr size_t MAX_PATH_DEPTH = 1024;
+
+    // The list's blocks, or an empty list if they don't fit the posting
+    // sections or don't add up to its count. Checked per lookup rather than
+    // on open; a list has one block per 128 postings, so this costs little
+    // next to decoding it.
+    PostingList postingsOf(const DiskTrigramEntry& t) const {
+        uint32_t blocks = PostingCodec::blockCountFor(t.postingCount);
+        if (uint64_t(t.firstBlock) + blocks > header_->postingBlockCount) return {};
+
+        uint64_t postings = 0;
+        for (uint32_t b = t.firstBlock; b < t.firstBlock + blocks; ++b) {
+            const auto& block = postingBlocks_[b];
+            if (block.count == 0 || block.count > PostingCodec::BLOCK_SIZE || block.bitWidth > 32) return {};
+            uint64_t words = (uint64_t(block.count - 1) * block.bitWidth + 31) / 32;
+            if (block.dataOffset + words > header_->postingDataSize) return {};
+            postings += block.count;
+        }
+        if (postings != t.postingCount) return {};
+
+        return { postingBlocks_ + t.firstBlock, postingData_, t.postingCount };
+    }
+
+    // Where wchar_t is 32 bits the UTF-16 pools can't be read in place.
+    // Rather than copying both on open, names are widened a WIDE_CHUNK of
+    // the pools at a time, the first time one in the chunk is read; a scan
+    // over every name still ends up widening all of them, at 4 bytes a char.
+    struct WidePools {
+        const DiskChar* source = nullptr;  // both pools, in the mapping
+        std::unique_ptr<wchar_t[]> chars;
+        std::unique_ptr<std::atomic<bool>[]> ready;  // per chunk
+        std::mutex mutex;
+    };
+    static constexpr uint64_t WIDE_CHUNK = 64 * 1024;
+
+    // Makes chars [first, first + length) of the pools readable as wchar_t.
+    void widen(uint64_t first, uint32_t length) const {
+        if constexpr (sizeof(wchar_t) != sizeof(DiskChar)) {
+            if (length == 0) return;
+            auto& wide = *widePools_;
+            for (uint64_t c = first / WIDE_CHUNK; c <= (first + length - 1) / WIDE_CHUNK; ++c) {
+                if (wide.ready[c].load(std::memory_order_acquire)) continue;
+
+                std::lock_guard lock(wide.mutex);
+                if (wide.ready[c].load(std::memory_order_relaxed)) continue;
+                uint64_t from = c * WIDE_CHUNK;
+                uint64_t to = std::min<uint64_t>(from + WIDE_CHUNK, header_->stringPoolSize * 2ull);
+                std::copy(wide.source + from, wide.source + to, wide.chars.get() + from);
+                wide.ready[c].store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    void loadDelta(const std::wstring& deltaPath) {
+        delta_.load(deltaPath, header_->buildTimestamp, header_->entryCount);
+
+        for (uint32_t i = 0; i < delta_.addedCount(); ++i) {
+            deltaExtensionIds_.push_back(internExtension(delta_.foldedName(i)));
+        }
+
+        for (uint32_t idx : delta_.tombstones()) {
+            if (idx < entryCount()) markDeleted(idx);
+        }
+    }
+
+    // <0, 0 or >0 as extension id compares to folded
+    int compareExtension(uint32_t id, std::wstring_view folded) const {
+        // kept inside the pool, which open() only checks the end of
+        uint32_t first = std::min(extensionOffsets_[id], header_->extensionPoolSize);
+        uint32_t last = std::clamp(extensionOffsets_[id + 1], first, header_->extensionPoolSize);
+        const DiskChar* ext = extensionPool_ + first;
+        size_t length = last - first;
+        for (size_t i = 0; i < length && i < folded.size(); ++i) {
+            uint16_t a = ext[i];
+            uint16_t b = static_cast<uint16_t>(folded[i]);
+            if (a != b) return a < b ? -1 : 1;
+        }
+        return length < folded.size() ? -1 : length > folded.size() ? 1 : 0;
+    }
+
+    // Id for the extension of an added entry, taking a new one if the base
+    // doesn't know it.
+    uint16_t internExtension(std::wstring_view name) {
+        std::wstring ext = CaseFold::fold(extensionOf(name));
+        uint32_t id = findExtension(ext);
+        if (id != NOT_FOUND) return static_cast<uint16_t>(id);
+
+        id = extensionCount();
+        if (id >= FileMetadata::OTHER_EXTENSION) return FileMetadata::OTHER_EXTENSION;
+        addedExtensions_.emplace(std::move(ext), id);
+        return static_cast<uint16_t>(id);
+    }
+
+    void markDeleted(uint32_t idx) {
+        if ((idx >> 6) >= deadBits_.size()) {
+            deadBits_.resize((std::max(idx + 1, entryCount()) + 63) / 64, 0);
+        }
+        deadBits_[idx >> 6] |= 1ULL << (idx & 63);
+    }
+
     void swap(DiskIndex& other) noexcept {
-        std::swap(hFile_, other.hFile_);
-        std::swap(hMapping_, other.hMapping_);
-        std::swap(base_, other.base_);
-        std::swap(fileSize_, other.fileSize_);
+        std::swap(file_, other.file_);
         std::swap(header_, other.header_);
         std::swap(entries_, other.entries_);
+        std::swap(fileSizes_, other.fileSizes_);
+        std::swap(parentIndex_, other.parentIndex_);
+        std::swap(subtreeEnd_, other.subtreeEnd_);
+        std::swap(refOrder_, other.refOrder_);
+        std::swap(modifiedTimes_, other.modifiedTimes_);
+        std::swap(extensionIds_, other.extensionIds_);
+        std::swap(extensionOffsets_, other.extensionOffsets_);
+        std::swap(extensionPool_, other.extensionPool_);
         std::swap(stringPool_, other.stringPool_);
+        std::swap(foldedPool_, other.foldedPool_);
         std::swap(trigrams_, other.trigrams_);
+        std::swap(postingBlocks_, other.postingBlocks_);
         std::swap(postingData_, other.postingData_);
-        std::swap(refToIndex_, other.refToIndex_);
+        std::swap(driveMetadata_, other.driveMetadata_);
+        std::swap(metaCount_, other.metaCount_);
+        std::swap(widePools_, other.widePools_);
+        std::swap(addedExtensions_, other.addedExtensions_);
+        std::swap(deltaExtensionIds_, other.deltaExtensionIds_);
+        std::swap(delta_, other.delta_);
+        std::swap(deadBits_, other.deadBits_);
     }
 
-    HANDLE hFile_ = INVALID_HANDLE_VALUE;
-    HANDLE hMapping_ = nullptr;
-    void* base_ = nullptr;
-    size_t fileSize_ = 0;
+    MappedFile file_;
 
     const DiskIndexHeader* header_ = nullptr;
     const DiskFileEntry* entries_ = nullptr;
+    const uint64_t* fileSizes_ = nullptr;
+    const uint32_t* parentIndex_ = nullptr;
+    const uint32_t* subtreeEnd_ = nullptr;
+    const uint32_t* refOrder_ = nullptr;
+    const uint32_t* modifiedTimes_ = nullptr;
+    const uint16_t* extensionIds_ = nullptr;
+    const uint32_t* extensionOffsets_ = nullptr;
+    const DiskChar* extensionPool_ = nullptr;
     const wchar_t* stringPool_ = nullptr;
+    const wchar_t* foldedPool_ = nullptr;
     const DiskTrigramEntry* trigrams_ = nullptr;
+    const DiskPostingBlock* postingBlocks_ = nullptr;
     const uint32_t* postingData_ = nullptr;
-
-    std::unordered_map<uint64_t, uint32_t> refToIndex_;
+    const DriveMetadata* driveMetadata_ = nullptr;
+    uint32_t metaCount_ = 0;
+    std::unique_ptr<WidePools> widePools_;  // where wchar_t isn't 16 bits
+    std::unordered_map<std::wstring, uint32_t> addedExtensions_;  // ones only the delta has
+    std::vector<uint16_t> deltaExtensionIds_;
+
+    DeltaSegment delta_;
+    std::vector<uint64_t> deadBits_;  // tombstones, one bit per entry
 };
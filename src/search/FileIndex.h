@@ -1,9 +1,13 @@
 #pragma once
 
-#include "../../framework.h"
 #include <unordered_map>
 #include <shared_mutex>
 #include <string_view>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
 
 #pragma pack(push, 1)
 struct FileEntry {
@@ -71,6 +75,7 @@ public:
 
         entries_.push_back(entry);
         refToIndex_[fileRef] = idx;
+        parentIndex_.clear();  // the new entry may be an earlier entry's parent
 
         return idx;
     }
@@ -84,21 +89,37 @@ public:
         return stringPool_.get(entry.nameOffset, entry.nameLength);
     }
 
+    // Parents can be enumerated after their children, so the parent column
+    // is filled in one pass once all entries are added. Until then parents
+    // are looked up by ref.
+    void resolveParents() {
+        parentIndex_.assign(entries_.size(), NO_PARENT);
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            auto it = refToIndex_.find(entries_[i].parentRef);
+            if (it != refToIndex_.end() && it->second != i) {
+                parentIndex_[i] = it->second;
+            }
+        }
+    }
+
+    uint32_t parentOf(uint32_t index) const {
+        if (!parentIndex_.empty()) return parentIndex_[index];
+        auto it = refToIndex_.find(entries_[index].parentRef);
+        return it != refToIndex_.end() && it->second != index ? it->second : NO_PARENT;
+    }
+
     std::wstring buildFullPath(uint32_t entryIndex) const {
         std::vector<std::wstring_view> parts;
         parts.reserve(32);
 
         uint32_t current = entryIndex;
-        while (current < entries_.size()) {
+        while (current < entries_.size() && parts.size() < MAX_PATH_DEPTH) {
             const auto& entry = entries_[current];
             auto name = stringPool_.get(entry.nameOffset, entry.nameLength);
             if (name.empty()) break;
 
             parts.push_back(name);
-
-            auto it = refToIndex_.find(entry.parentRef);
-            if (it == refToIndex_.end()) break;
-            current = it->second;
+            current = parentOf(current);
         }
 
         if (parts.empty()) return {};
@@ -128,18 +149,26 @@ public:
         entries_.shrink_to_fit();
         stringPool_.clear();
         refToIndex_.clear();
+        parentIndex_.clear();
+        parentIndex_.shrink_to_fit();
     }
 
     size_t memoryUsage() const {
         return entries_.capacity() * sizeof(FileEntry) +
                stringPool_.memoryUsage() +
-               refToIndex_.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+               refToIndex_.size() * (sizeof(uint64_t) + sizeof(uint32_t)) +
+               parentIndex_.capacity() * sizeof(uint32_t);
     }
 
     const std::vector<FileEntry>& entries() const { return entries_; }
 
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
 private:
+    static constexpr size_t MAX_PATH_DEPTH = 1024;
+
     std::vector<FileEntry> entries_;
     StringPool stringPool_;
     std::unordered_map<uint64_t, uint32_t> refToIndex_;
+    std::vector<uint32_t> parentIndex_;
 };
@@ -1,69 +1,151 @@
 #pragma once
 
-#include "../../framework.h"
 #include "DiskIndex.h"
 #include "IndexBuilder.h"
+#include "ChangeJournal.h"
+#ifdef _WIN32
+#include "UsnJournalSource.h"
+#endif
+#include "PostingIntersect.h"
+#include "TopKRanker.h"
+#include "FuzzyMatcher.h"
+#include "QueryCache.h"
+#include "SearchScope.h"
+#include "MetadataFilter.h"
+#include "SearchWorkerPool.h"
 #include "SearchResult.h"
+#include "FrecencyStore.h"
+#include "ContentMatcher.h"
 #include <shared_mutex>
 #include <functional>
+#include <condition_variable>
+#include <deque>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 class FileSearchService {
 public:
     using ResultCallback = std::function<void(const std::vector<SearchResult>&, bool complete)>;
     using ProgressCallback = std::function<void(float progress, const std::wstring& status)>;
+    using JournalSourceFactory =
+        std::function<std::unique_ptr<ChangeJournalSource>(std::vector<DriveMetadata> positions)>;
+
+    // Names matches entry names; Contents greps the files the query's path
+    // terms and metadata operators pick (see runContentSearch).
+    enum class SearchMode : uint8_t { Names, Contents };
+
+    FileSearchService() {
+        searchThread_ = std::thread([this]() { searchLoop(); });
+    }
 
-    FileSearchService() = default;
     ~FileSearchService() {
         stopIndexing();
+
+        stopSearch_ = true;
+        ++searchId_;
+        ++searchWake_;
+        searchWake_.notify_one();
+        searchThread_.join();
+        delete pendingSearch_.exchange(nullptr);
+        frecency_.saveIfDirty();
     }
 
     FileSearchService(const FileSearchService&) = delete;
     FileSearchService& operator=(const FileSearchService&) = delete;
 
     void startIndexing(ProgressCallback progressCallback = nullptr) {
-        if (indexing_) return;
+        if (indexing_ || indexThread_.joinable()) return;
 
         progressCallback_ = progressCallback;
         cancelIndex_ = false;
         indexThread_ = std::thread([this]() { indexThreadFunc(); });
     }
 
+    // See IndexBuilder::setMemoryBudget; applies to the next build.
+    void setIndexMemoryBudget(size_t bytes) {
+        indexMemoryBudget_ = bytes;
+    }
+
+    // Fuzzy subsequence matching (see FuzzyQuery) instead of plain substrings.
+    void setFuzzyMatching(bool enabled) {
+        fuzzyMatching_ = enabled;
+    }
+
+    // Keep following the change journal once the index is up to date.
+    void setLiveUpdates(bool enabled) {
+        liveUpdates_ = enabled;
+    }
+
+    // Where live updates come from; defaults to the volumes' USN journals.
+    void setJournalSourceFactory(JournalSourceFactory factory) {
+        journalSourceFactory_ = std::move(factory);
+    }
+
+    // Serves searches from an existing index file, without building or
+    // updating it; for tools such as the search benchmark.
+    bool openIndex(const std::wstring& path) {
+        std::unique_lock lock(indexMutex_);
+        ++indexGeneration_;
+        indexReady_ = index_.open(path);
+        return indexReady_;
+    }
+
     void stopIndexing() {
-        cancelIndex_ = true;
+        {
+            std::lock_guard lock(watchMutex_);
+            cancelIndex_ = true;
+        }
+        watchCv_.notify_all();
         cancelSearch_ = true;
 
         if (indexThread_.joinable()) {
             indexThread_.join();
         }
-        if (searchThread_.joinable()) {
-            searchThread_.join();
-        }
     }
 
-    void search(const std::wstring& query, ResultCallback callback) {
+    // Never waits for the previous search: bumping the id makes it stop at
+    // its next checkpoint, and the search thread only ever picks up the
+    // latest query, skipping any it didn't get to.
+    void search(const std::wstring& query, ResultCallback callback, SearchMode mode = SearchMode::Names) {
+        uint64_t id = ++searchId_;
         if (query.empty()) {
             callback({}, true);
             return;
         }
 
-        cancelSearch_ = true;
-        if (searchThread_.joinable()) {
-            searchThread_.join();
-        }
-
         cancelSearch_ = false;
-        uint64_t id = ++searchId_;
-
-        searchThread_ = std::thread([this, query, callback, id]() {
-            searchThreadFunc(query, callback, id);
-        });
+        delete pendingSearch_.exchange(new SearchRequest{ query, std::move(callback), id, mode });
+        ++searchWake_;
+        searchWake_.notify_one();
     }
 
     void cancelSearch() {
         cancelSearch_ = true;
     }
 
+    // Forgets the matches kept for narrowing; call when a new search
+    // session starts so one session's results don't outlive it.
+    void resetQueryCache() {
+        queryCache_.clear();
+    }
+
+    // Ranks the result's entry higher in later searches; call when the
+    // user acts on it. The search thread saves the change once it's idle.
+    void recordUse(const SearchResult& result) {
+        if (result.refKey == 0) return;
+        frecency_.recordUse(result.refKey);
+        ++searchWake_;
+        searchWake_.notify_one();
+    }
+
     bool isIndexing() const { return indexing_; }
     bool isIndexReady() const { return indexReady_; }
 
@@ -87,17 +169,20 @@ private:
         indexProgress_ = 0.0f;
 
         std::wstring indexPath = DiskIndex::getIndexPath();
+        frecency_.load(FrecencyStore::pathFor(indexPath));
 
         // try to load existing index first (instant availability)
         {
             std::unique_lock lock(indexMutex_);
             if (index_.open(indexPath)) {
                 indexReady_ = true;
+                ++indexGeneration_;
                 setStatus(L"Index loaded, checking for updates...");
             }
         }
 
         IndexBuilder builder;
+        builder.setMemoryBudget(indexMemoryBudget_);
 
         auto progressCb = [this](float progress, const std::wstring& status) {
             indexProgress_ = progress;
@@ -121,11 +206,14 @@ private:
             // reload the updated index
             std::unique_lock lock(indexMutex_);
             index_.close();
+            ++indexGeneration_;
             if (index_.open(indexPath)) {
                 indexReady_ = true;
 
                 std::wstring statusMsg = L"Ready - " + std::to_wstring(index_.entryCount()) + L" files";
-                if (stats.wasIncremental) {
+                if (stats.writeFailed) {
+                    statusMsg += L" (couldn't save the index)";
+                } else if (stats.wasIncremental) {
                     if (stats.filesAdded > 0 || stats.filesRemoved > 0) {
                         statusMsg += L" (+" + std::to_wstring(stats.filesAdded) +
                                      L"/-" + std::to_wstring(stats.filesRemoved) + L")";
@@ -137,138 +225,694 @@ private:
 
         indexProgress_ = 1.0f;
         indexing_ = false;
+
+        if (liveUpdates_ && indexReady_ && !cancelIndex_) {
+            watchChanges(indexPath);
+        }
+    }
+
+    // Tails the change journal so results include files created seconds
+    // ago. Changes go into the index's in-memory delta as soon as they are
+    // read; the delta is saved every DELTA_SAVE_INTERVAL_MS and compacted
+    // once it has grown too large.
+    void watchChanges(const std::wstring& indexPath) {
+        auto source = makeJournalSource();
+        if (!source) return;
+        std::vector<JournalChange> changes;
+        bool dirty = false;
+        uint64_t lastSave = steadyMillis();
+
+        while (!cancelIndex_) {
+            {
+                std::unique_lock lock(watchMutex_);
+                watchCv_.wait_for(lock, std::chrono::milliseconds(WATCH_INTERVAL_MS),
+                                  [this]() { return cancelIndex_.load(); });
+            }
+
+            changes.clear();
+            if (!source->read(changes, cancelIndex_)) {
+                if (cancelIndex_) break;
+                if (rebuildLive(indexPath)) dirty = false;
+                source = makeJournalSource();
+                continue;
+            }
+
+            // applied even when cancelled: the source has already moved past them
+            if (!changes.empty()) {
+                std::unique_lock lock(indexMutex_);
+                index_.applyChanges(changes);
+                index_.recordPositions(source->positions());
+                ++indexGeneration_;
+                dirty = true;
+                setStatus(L"Ready - " + std::to_wstring(index_.entryCount() - index_.delta().tombstoneCount()) +
+                          L" files");
+            }
+
+            uint64_t now = steadyMillis();
+            if (dirty && !cancelIndex_ && now - lastSave >= DELTA_SAVE_INTERVAL_MS) {
+                dirty = !saveOrCompact(indexPath);
+                lastSave = now;
+            }
+        }
+
+        if (dirty) {
+            std::shared_lock lock(indexMutex_);
+            index_.delta().save(DeltaSegment::pathFor(indexPath));
+        }
+    }
+
+    std::unique_ptr<ChangeJournalSource> makeJournalSource() const {
+        std::vector<DriveMetadata> positions;
+        {
+            std::shared_lock lock(indexMutex_);
+            positions = index_.driveMetadata();
+        }
+        if (journalSourceFactory_) return journalSourceFactory_(std::move(positions));
+#ifdef _WIN32
+        return std::make_unique<UsnJournalSource>(std::move(positions));
+#else
+        return nullptr;  // no change journal to follow here
+#endif
+    }
+
+    // False if the changes are still only in memory, so the caller tries
+    // again at the next save.
+    bool saveOrCompact(const std::wstring& indexPath) {
+        IndexBuilder builder;
+        builder.setMemoryBudget(indexMemoryBudget_);
+
+        {
+            std::shared_lock lock(indexMutex_);
+            if (!IndexBuilder::needsCompaction(index_)) {
+                return index_.delta().save(DeltaSegment::pathFor(indexPath));
+            }
+            builder.loadCompacted(index_);
+        }
+
+        // searches keep using the current index while the new one is written;
+        // nothing else touches the delta meanwhile since only this thread does
+        IndexBuilder::BuildStats stats;
+        std::wstring newPath = indexPath + L".new";
+        return builder.writeCompacted(newPath, cancelIndex_, stats) && replaceIndex(indexPath, newPath);
     }
 
-    void searchThreadFunc(std::wstring query, ResultCallback callback, uint64_t searchId) {
+    // The journal can't be followed any more, so rescan from scratch. False
+    // if the old index is still in place; the journal's next read fails
+    // again and so retries the rebuild.
+    bool rebuildLive(const std::wstring& indexPath) {
+        setStatus(L"Change journal was reset, rebuilding...");
+
+        IndexBuilder builder;
+        builder.setMemoryBudget(indexMemoryBudget_);
+
+        std::wstring newPath = indexPath + L".new";
+        auto stats = builder.build(newPath, cancelIndex_);
+        if (cancelIndex_ || !stats.indexWritten || !replaceIndex(indexPath, newPath)) return false;
+
+        setStatus(L"Ready - " + std::to_wstring(stats.filesIndexed) + L" files");
+        return true;
+    }
+
+    // The open index keeps the file mapped, so it is closed before the swap.
+    // Its delta is saved first: should the swap fail, the old index is
+    // reopened with every change applied so far and false is returned.
+    bool replaceIndex(const std::wstring& indexPath, const std::wstring& newPath) {
+        std::unique_lock lock(indexMutex_);
+        std::wstring deltaPath = DeltaSegment::pathFor(indexPath);
+        index_.delta().save(deltaPath);
+        index_.close();
+        ++indexGeneration_;
+
+        bool replaced = FileWriter::replace(newPath, indexPath);
+        if (replaced) {
+            FileWriter::remove(deltaPath);
+        } else {
+            FileWriter::remove(newPath);
+        }
+        indexReady_ = index_.open(indexPath);
+        return replaced;
+    }
+
+    struct SearchRequest {
+        std::wstring query;
+        ResultCallback callback;
+        uint64_t id;
+        SearchMode mode;
+    };
+
+    void searchLoop() {
+        while (!stopSearch_) {
+            uint32_t wake = searchWake_;
+            std::unique_ptr<SearchRequest> request(pendingSearch_.exchange(nullptr));
+            if (!request) {
+                frecency_.saveIfDirty();
+                searchWake_.wait(wake);
+                continue;
+            }
+            if (request->mode == SearchMode::Contents) {
+                runContentSearch(request->query, request->callback, request->id);
+            } else {
+                runSearch(request->query, request->callback, request->id);
+            }
+        }
+    }
+
+    // A run of entries to scan: positions [first, last) of ids, or the
+    // entry indices themselves when ids is null.
+    struct ScanPart {
+        enum class Filter : uint8_t { None, PrefixOnly, SkipPrefix };
+
+        const std::vector<uint32_t>* ids;
+        uint32_t first;
+        uint32_t last;
+        Filter filter;  // splits a short query's prefix and infix stages
+    };
+
+    struct ScanChunk {
+        uint32_t part;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    void runSearch(const std::wstring& fullQuery, const ResultCallback& callback, uint64_t searchId) {
         std::shared_lock lock(indexMutex_);
 
-        if (!index_.isOpen() || query.empty()) {
+        // with operators, a query needn't name anything: "ext:log sort:size"
+        MetadataFilter filter;
+        const std::wstring nameQuery = filter.extract(fullQuery);
+        const bool filtered = filter.active();
+        const bool sorted = filter.sort() != MetadataFilter::Sort::Relevance;
+
+        std::vector<std::wstring> pathTerms;
+        const std::wstring query = SearchScope::split(nameQuery, pathTerms, !filtered && !sorted);
+
+        SearchScope scope;
+        if (!index_.isOpen() || (query.empty() && !filtered && !sorted) || !scope.resolve(index_, pathTerms) ||
+            !filter.resolve(index_)) {
             callback({}, true);
             return;
         }
 
-        std::vector<SearchResult> results;
-        results.reserve(200);
+        auto cancelled = [&]() { return cancelSearch_ || searchId != searchId_ || stopSearch_; };
+
+        const bool fuzzy = fuzzyMatching_ && !query.empty();
+        FuzzyQuery fuzzyQuery(fuzzy ? std::wstring_view(query) : std::wstring_view{});
+        if (fuzzy && fuzzyQuery.empty()) {
+            callback({}, true);
+            return;
+        }
+        const std::wstring foldedQuery = CaseFold::fold(query);
+        const uint64_t generation = indexGeneration_;
+
+        // entries the user keeps acting on rank higher, by a per-entry boost
+        frecency_.resolve(index_, generation);
+        const uint8_t* boosts = sorted ? nullptr : frecency_.boosts();
+        const int boostScale = fuzzy ? FUZZY_BOOST_SCALE : 1;
+        const int maxBoost = boosts ? frecency_.maxBoost() * boostScale : 0;
+        const int maxScore = sorted ? INT32_MAX
+                                    : (fuzzy ? fuzzyQuery.maxScore() : query.empty() ? 0 : MAX_SCORE) + maxBoost;
+        const uint32_t entryCount = static_cast<uint32_t>(index_.entryCount());
+        const uint32_t baseCount = index_.baseEntryCount();
+
+        // every match is kept so the next keystroke can narrow them, unless
+        // the scan stops early or there are too many to be worth keeping
+        std::wstring scopeKey;
+        for (const auto& term : pathTerms) {
+            scopeKey += term;
+            scopeKey += L'\n';
+        }
+        scopeKey += filter.key();
+        QueryCache::Matches previous = queryCache_.narrowFrom(scopeKey, foldedQuery, fuzzy, generation);
+
+        // base entries only need their ancestry checked once the delta may
+        // have moved them; their pre-order ranges are otherwise exact
+        const bool checkAncestry = scope.active();
+        const bool deltaChanged = !index_.delta().empty();
+
+        // Workers rank into their own TopKRanker and fold it into the shared
+        // one after every chunk; worker 0 (this thread) streams from it.
+        TopKRanker ranker(MAX_RESULTS);
+        std::mutex rankerMutex;
+        std::atomic<bool> saturated{false};
+        std::atomic<bool> complete{true};
+        std::atomic<size_t> matchCount{0};
+        std::vector<std::vector<uint32_t>> matches(searchPool_.size());
+        uint64_t lastStreamed = 0;
+        uint64_t lastStreamTime = steadyMillis();
+
+        auto scan = [&](std::vector<ScanPart> parts) {
+            std::deque<std::vector<uint32_t>> restricted;
+            if (scope.active()) {
+                std::vector<ScanPart> scoped;
+                for (const auto& part : parts) {
+                    if (part.ids) {
+                        auto& ids = restricted.emplace_back();
+                        scope.restrict(*part.ids, part.first, part.last, baseCount, ids);
+                        scoped.push_back({ &ids, 0, static_cast<uint32_t>(ids.size()), part.filter });
+                    } else {
+                        scope.forEachRange(part.first, part.last, baseCount, [&](uint32_t first, uint32_t last) {
+                            scoped.push_back({ nullptr, first, last, part.filter });
+                        });
+                    }
+                }
+                parts = std::move(scoped);
+            }
 
-        if (query.length() >= 3) {
-            // trigram search
-            std::vector<uint32_t> candidates = trigramSearch(query);
+            // the column scan stands in for ranges; lists are checked entry by entry
+            if (filtered) {
+                std::vector<ScanPart> kept;
+                for (const auto& part : parts) {
+                    auto& ids = restricted.emplace_back();
+                    if (part.ids) {
+                        filter.restrict(index_, *part.ids, part.first, part.last, ids);
+                    } else {
+                        filter.scan(index_, part.first, part.last, ids);
+                    }
+                    kept.push_back({ &ids, 0, static_cast<uint32_t>(ids.size()), part.filter });
+                }
+                parts = std::move(kept);
+            }
 
-            for (uint32_t idx : candidates) {
-                if (cancelSearch_ || searchId != searchId_) return;
-                if (idx >= index_.entryCount()) continue;
+            std::vector<ScanChunk> chunks;
+            for (uint32_t p = 0; p < parts.size(); ++p) {
+                for (uint32_t first = parts[p].first; first < parts[p].last;) {
+                    uint32_t last = first + std::min(SCAN_CHUNK, parts[p].last - first);
+                    chunks.push_back({ p, first, last });
+                    first = last;
+                }
+            }
 
-                const auto& entry = index_.entry(idx);
-                auto name = index_.getName(idx);
+            std::atomic<size_t> nextChunk{0};
+            searchPool_.run([&](size_t worker) {
+                TopKRanker local(MAX_RESULTS);
+                auto& found = matches[worker];
+
+                for (;;) {
+                    size_t c = nextChunk++;
+                    if (c >= chunks.size() || saturated || cancelled()) break;
+
+                    const ScanChunk& chunk = chunks[c];
+                    const ScanPart& part = parts[chunk.part];
+                    const size_t foundBefore = found.size();
+
+                    for (uint32_t pos = chunk.first; pos < chunk.last; ++pos) {
+                        if ((pos % CANCEL_CHECK_INTERVAL) == 0 && cancelled()) return;
+
+                        uint32_t idx = part.ids ? (*part.ids)[pos] : pos;
+                        if (idx >= entryCount || index_.isDeleted(idx)) continue;
+
+                        auto name = index_.getName(idx);
+                        auto folded = index_.getFoldedName(idx);
+                        if (part.filter != ScanPart::Filter::None &&
+                            folded.starts_with(foldedQuery) != (part.filter == ScanPart::Filter::PrefixOnly)) {
+                            continue;
+                        }
+
+                        auto inScope = [&]() {
+                            return !checkAncestry || (idx < baseCount && !deltaChanged) || scope.contains(index_, idx);
+                        };
+
+                        int score = boosts ? boosts[idx] * boostScale : 0;
+                        uint32_t matchStart = 0;
+                        uint32_t matchLen = 0;
+                        if (query.empty()) {
+                            if (!inScope()) continue;
+                        } else if (fuzzy) {
+                            FuzzyMatch m;
+                            if (!fuzzyQuery.match(name, folded, m) || !inScope()) continue;
+                            score += m.score;
+                            matchStart = m.start;
+                            matchLen = m.end - m.start;
+                        } else {
+                            size_t matchPos = folded.find(foldedQuery);
+                            if (matchPos == std::wstring_view::npos || !inScope()) continue;
+                            score += calculateScore(name, query, matchPos);
+                            matchStart = static_cast<uint32_t>(matchPos);
+                            matchLen = static_cast<uint32_t>(query.length());
+                        }
+                        if (sorted) score = filter.sortScore(index_, idx);
+
+                        local.offer(idx, score, matchStart, matchLen);
+                        if (complete) found.push_back(idx);
+                    }
 
-                size_t matchPos = findMatchPosition(name, query);
-                if (matchPos == std::wstring::npos) continue;
+                    size_t added = found.size() - foundBefore;
+                    if (matchCount.fetch_add(added) + added > QueryCache::MAX_MATCHES) {
+                        complete = false;
+                    }
+                    if (!complete) std::vector<uint32_t>().swap(found);
+
+                    std::vector<SearchResult> streamed;
+                    {
+                        std::lock_guard rankerLock(rankerMutex);
+                        ranker.merge(local);
+                        // nothing left can beat what is already ranked
+                        if (ranker.saturated(maxScore)) {
+                            saturated = true;
+                            complete = false;
+                        }
+
+                        uint64_t now = steadyMillis();
+                        if (worker == 0 && now - lastStreamTime >= STREAM_INTERVAL_MS &&
+                            ranker.version() != lastStreamed) {
+                            streamed = materializeResults(ranker);
+                            lastStreamed = ranker.version();
+                            lastStreamTime = now;
+                        }
+                    }
+                    local.clear();
 
-                SearchResult r;
-                r.displayName = std::wstring(name);
-                r.fullPath = index_.buildFullPath(idx);
-                r.isDirectory = (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-                r.score = calculateScore(name, query, matchPos);
-                r.matchStart = matchPos;
-                r.matchLen = query.length();
+                    if (!streamed.empty()) callback(streamed, false);
+                }
+            });
+        };
 
-                results.push_back(std::move(r));
-                if (results.size() >= 200) break;
+        // fuzzy terms can skip characters, so only exact terms narrow the scan
+        std::vector<std::wstring_view> indexedTerms;
+        if (fuzzy) {
+            for (auto term : fuzzyQuery.exactTerms()) {
+                if (term.size() >= 3) indexedTerms.push_back(term);
+            }
+        } else if (query.length() >= 3) {
+            indexedTerms.push_back(query);
+        }
+
+        using Filter = ScanPart::Filter;
+        const ScanPart added = { nullptr, baseCount, entryCount, Filter::None };  // no postings until compacted
+        auto listPart = [](const std::vector<uint32_t>& ids, Filter filter = Filter::None) {
+            return ScanPart{ &ids, 0, static_cast<uint32_t>(ids.size()), filter };
+        };
+        std::vector<uint32_t> candidates;
+
+        if (previous) {
+            // an extension of the last query only matches a subset of its matches
+            scan({ listPart(*previous) });
+        } else if (!indexedTerms.empty()) {
+            candidates = trigramSearch(indexedTerms);
+            scan({ listPart(candidates), added });
+        } else if (query.empty()) {
+            scan({ { nullptr, 0, entryCount, Filter::None } });
+        } else if (!fuzzy) {
+            // 1-2 chars: names starting with the query outscore every other
+            // match, so the rest is only scanned if they don't fill the results
+            candidates = shortPrefixSearch(foldedQuery);
+            scan({ listPart(candidates, Filter::PrefixOnly), added });
+
+            bool prefixesWin = !sorted && ranker.full() && ranker.threshold() > MAX_INFIX_SCORE + maxBoost;
+            if (prefixesWin) {
+                complete = false;
+            } else if (!saturated && !cancelled()) {
+                std::vector<uint32_t> containing;
+                if (shortContainsSearch(foldedQuery, containing)) {
+                    scan({ listPart(containing, Filter::SkipPrefix) });
+                } else {
+                    scan({ { nullptr, 0, baseCount, Filter::SkipPrefix } });
+                }
             }
         } else {
-            // short query - check short names first, then linear scan
-            auto shortIndices = index_.getShortNameIndices();
-            for (uint32_t idx : shortIndices) {
-                if (cancelSearch_ || searchId != searchId_) return;
-                if (idx >= index_.entryCount()) continue;
-
-                const auto& entry = index_.entry(idx);
-                auto name = index_.getName(idx);
-
-                size_t matchPos = findMatchPosition(name, query);
-                if (matchPos == std::wstring::npos) continue;
-
-                SearchResult r;
-                r.displayName = std::wstring(name);
-                r.fullPath = index_.buildFullPath(idx);
-                r.isDirectory = (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-                r.score = calculateScore(name, query, matchPos);
-                r.matchStart = matchPos;
-                r.matchLen = query.length();
-
-                results.push_back(std::move(r));
-                if (results.size() >= 200) break;
+            std::vector<uint32_t> containing;
+            if (fuzzyCharSearch(foldedQuery, containing)) {
+                scan({ listPart(containing), added });
+            } else {
+                scan({ { nullptr, 0, entryCount, Filter::None } });
             }
+        }
 
-            // linear scan for remaining
-            if (results.size() < 200) {
-                for (uint32_t idx = 0; idx < index_.entryCount() && results.size() < 200; ++idx) {
-                    if (cancelSearch_ || searchId != searchId_) return;
-
-                    const auto& entry = index_.entry(idx);
-                    if (entry.fileRef == 0) continue;  // deleted entry
-
-                    auto name = index_.getName(idx);
-                    if (name.size() < 3) continue;  // already checked
+        if (cancelled()) return;
 
-                    size_t matchPos = findMatchPosition(name, query);
-                    if (matchPos == std::wstring::npos) continue;
+        if (complete) {
+            std::vector<uint32_t> all;
+            all.reserve(matchCount);
+            for (auto& found : matches) {
+                all.insert(all.end(), found.begin(), found.end());
+            }
+            // chunks finish in any order
+            std::sort(all.begin(), all.end());
+            queryCache_.store(std::move(scopeKey), foldedQuery, fuzzy, generation, std::move(all));
+        }
 
-                    SearchResult r;
-                    r.displayName = std::wstring(name);
-                    r.fullPath = index_.buildFullPath(idx);
-                    r.isDirectory = (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-                    r.score = calculateScore(name, query, matchPos);
-                    r.matchStart = matchPos;
-                    r.matchLen = query.length();
+        callback(materializeResults(ranker), true);
+    }
 
-                    results.push_back(std::move(r));
+    // Searches file contents for the rest of the query, taken as one literal:
+    // "src/render ext:cpp glyph cache" finds lines holding "glyph cache" in
+    // the .cpp files below src/render. Without a path term or an operator
+    // nothing is searched, since a whole drive is too much for a keystroke.
+    //
+    // Workers take files in index order and results are kept in that order,
+    // file by file, so once MAX_RESULTS lines are found no later file can
+    // make the cut and the scan stops. The index lock is only taken to
+    // build each file's path; reading files runs without it.
+    void runContentSearch(const std::wstring& fullQuery, const ResultCallback& callback, uint64_t searchId) {
+        MetadataFilter filter;
+        std::vector<std::wstring> pathTerms;
+        const std::wstring literal = SearchScope::split(filter.extract(fullQuery), pathTerms, false);
+        const ContentMatcher matcher(literal);
+
+        auto cancelled = [&]() { return cancelSearch_ || searchId != searchId_ || stopSearch_; };
+
+        // the files to read, in index order
+        std::vector<uint32_t> files;
+        uint64_t generation;
+        {
+            std::shared_lock lock(indexMutex_);
+            SearchScope scope;
+            if (!index_.isOpen() || matcher.empty() || (pathTerms.empty() && !filter.active()) ||
+                !scope.resolve(index_, pathTerms) || !filter.resolve(index_)) {
+                callback({}, true);
+                return;
+            }
+            generation = indexGeneration_;
+
+            const uint32_t entryCount = static_cast<uint32_t>(index_.entryCount());
+            const uint32_t baseCount = index_.baseEntryCount();
+            const bool deltaChanged = !index_.delta().empty();
+
+            std::vector<uint32_t> passed;
+            auto collect = [&](uint32_t first, uint32_t last) {
+                if (filter.active()) {
+                    filter.scan(index_, first, last, passed);
+                } else {
+                    passed.resize(last - first);
+                    std::iota(passed.begin(), passed.end(), first);
+                }
+                for (uint32_t idx : passed) {
+                    if (index_.isDeleted(idx) || (index_.entry(idx).attributes & FileAttributes::DIRECTORY)) continue;
+                    if (index_.fileSize(idx) != FileMetadata::UNKNOWN_SIZE &&
+                        index_.fileSize(idx) > MAX_CONTENT_FILE_SIZE) {
+                        continue;
+                    }
+                    if (scope.active() && (idx >= baseCount || deltaChanged) && !scope.contains(index_, idx)) continue;
+                    files.push_back(idx);
                 }
+            };
+            if (scope.active()) {
+                scope.forEachRange(0, baseCount, baseCount, collect);
+            } else {
+                collect(0, baseCount);
             }
+            collect(baseCount, entryCount);
         }
 
-        if (cancelSearch_ || searchId != searchId_) return;
+        struct ContentHit {
+            uint32_t index;
+            SearchResult result;
+        };
+        auto before = [](const ContentHit& a, const ContentHit& b) {
+            return a.index != b.index ? a.index < b.index : a.result.line < b.result.line;
+        };
+
+        std::vector<ContentHit> hits;  // the first MAX_RESULTS, once sorted
+        std::mutex hitsMutex;
+        std::atomic<uint32_t> cutoff{UINT32_MAX};  // files past this can't make the results
+        std::atomic<bool> indexChanged{false};
+        std::atomic<size_t> nextFile{0};
+        uint64_t version = 0;
+        uint64_t lastStreamed = 0;
+        uint64_t lastStreamTime = steadyMillis();
+
+        auto sortedResults = [&]() {
+            std::sort(hits.begin(), hits.end(), before);
+            std::vector<SearchResult> results;
+            results.reserve(hits.size());
+            for (const auto& hit : hits) results.push_back(hit.result);
+            return results;
+        };
+
+        searchPool_.run([&](size_t worker) {
+            std::vector<ContentHit> found;
+            MappedFile file;
+
+            for (;;) {
+                size_t f = nextFile++;
+                if (f >= files.size() || files[f] > cutoff || indexChanged || cancelled()) break;
+                const uint32_t idx = files[f];
+
+                SearchResult base;
+                {
+                    std::shared_lock lock(indexMutex_);
+                    if (indexGeneration_ != generation) {
+                        indexChanged = true;
+                        break;
+                    }
+                    const auto& e = index_.entry(idx);
+                    base.fullPath = index_.buildFullPath(idx);
+                    base.refKey = DiskIndex::makeRefKey(e.driveIndex, e.fileRef);
+                }
+
+                if (!file.open(base.fullPath, MappedFile::Access::Sequential, MappedFile::Share::All) ||
+                    file.size() > MAX_CONTENT_FILE_SIZE) {
+                    continue;
+                }
+
+                found.clear();
+                matcher.forEachMatch(file.data(), file.size(), [&](ContentMatcher::LineMatch&& m) {
+                    SearchResult r = base;
+                    r.displayName = std::move(m.text);
+                    r.matchStart = m.matchStart;
+                    r.matchLen = m.matchLen;
+                    r.line = m.line;
+                    found.push_back({ idx, std::move(r) });
+                    return found.size() < MAX_RESULTS && !cancelled();
+                });
+                file.close();
+
+                std::vector<SearchResult> streamed;
+                {
+                    std::lock_guard hitsLock(hitsMutex);
+                    if (!found.empty()) {
+                        std::move(found.begin(), found.end(), std::back_inserter(hits));
+                        ++version;
+                        if (hits.size() >= MAX_RESULTS) {
+                            std::sort(hits.begin(), hits.end(), before);
+                            hits.resize(MAX_RESULTS);
+                            cutoff = hits.back().index;
+                        }
+                    }
+
+                    uint64_t now = steadyMillis();
+                    if (worker == 0 && now - lastStreamTime >= STREAM_INTERVAL_MS && version != lastStreamed) {
+                        streamed = sortedResults();
+                        lastStreamed = version;
+                        lastStreamTime = now;
+                    }
+                }
+
+                if (!streamed.empty()) callback(streamed, false);
+            }
+        });
 
-        std::sort(results.begin(), results.end());
-        if (results.size() > 100) results.resize(100);
+        if (cancelled()) return;
+        callback(sortedResults(), true);
+    }
 
-        callback(results, true);
+    // Only the final K candidates ever get their full path built.
+    std::vector<SearchResult> materializeResults(const TopKRanker& ranker) const {
+        std::vector<SearchResult> results;
+        auto ranked = ranker.sorted();
+        results.reserve(ranked.size());
+
+        for (const auto& c : ranked) {
+            auto name = index_.getName(c.index);
+            const auto& e = index_.entry(c.index);
+
+            SearchResult r;
+            r.displayName = std::wstring(name);
+            r.fullPath = index_.buildFullPath(c.index);
+            r.isDirectory = (e.attributes & FileAttributes::DIRECTORY) != 0;
+            r.score = c.score;
+            r.matchStart = c.matchStart;
+            r.matchLen = c.matchLen;
+            r.refKey = DiskIndex::makeRefKey(e.driveIndex, e.fileRef);
+
+            results.push_back(std::move(r));
+        }
+        return results;
     }
 
-    std::vector<uint32_t> trigramSearch(std::wstring_view query) const {
-        if (query.size() < 3) return {};
+    // Entries containing every term; terms shorter than 3 chars don't narrow it.
+    std::vector<uint32_t> trigramSearch(const std::vector<std::wstring_view>& terms) const {
+        std::vector<uint32_t> trigrams;
+        for (auto term : terms) {
+            for (size_t i = 0; i + 2 < term.size(); ++i) {
+                trigrams.push_back(DiskIndex::makeTrigram(CaseFold::fold(term[i]), CaseFold::fold(term[i + 1]),
+                                                          CaseFold::fold(term[i + 2])));
+            }
+        }
+        if (trigrams.empty()) return {};
 
-        std::vector<uint32_t> result;
-        bool first = true;
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
 
-        for (size_t i = 0; i + 2 < query.size(); ++i) {
-            uint32_t tri = DiskIndex::makeTrigram(query[i], query[i + 1], query[i + 2]);
+        std::vector<PostingList> lists;
+        lists.reserve(trigrams.size());
+        for (uint32_t tri : trigrams) {
             auto postings = index_.getPostings(tri);
-
             if (postings.empty()) return {};
+            lists.push_back(postings);
+        }
 
-            if (first) {
-                result.assign(postings.begin(), postings.end());
-                std::sort(result.begin(), result.end());
-                first = false;
+        return PostingIntersector::intersect(std::move(lists));
+    }
+
+    // Base entries that may start with a 1-2 char folded query.
+    std::vector<uint32_t> shortPrefixSearch(std::wstring_view folded) const {
+        std::vector<PostingList> lists = { index_.getPostings(DiskIndex::makeFirstCharKey(folded[0])) };
+        if (folded.size() > 1) {
+            lists.push_back(index_.getPostings(DiskIndex::makeBigram(folded[0], folded[1])));
+        }
+        return PostingIntersector::intersect(std::move(lists));
+    }
+
+    // Base entries that may contain a 1-2 char folded query; false when
+    // they are so many that a linear scan is cheaper.
+    bool shortContainsSearch(std::wstring_view folded, std::vector<uint32_t>& out) const {
+        out.clear();
+        if (folded.size() > 1) {
+            index_.getPostings(DiskIndex::makeBigram(folded[0], folded[1])).decodeTo(out);
+            return true;
+        }
+        return unite(index_.getCharPostings(folded[0]), out);
+    }
+
+    // A fuzzy query over at most two distinct chars only matches names
+    // holding both; false when that doesn't narrow the scan.
+    bool fuzzyCharSearch(std::wstring_view folded, std::vector<uint32_t>& out) const {
+        std::wstring chars;
+        for (wchar_t c : folded) {
+            if (c == L' ' || c == L'\'' || chars.find(c) != std::wstring::npos) continue;
+            if (chars.size() == 2) return false;
+            chars.push_back(c);
+        }
+
+        bool narrowed = false;
+        std::vector<uint32_t> ids;
+        for (wchar_t c : chars) {
+            if (!unite(index_.getCharPostings(c), ids)) continue;
+            if (narrowed) {
+                auto end = std::set_intersection(out.begin(), out.end(), ids.begin(), ids.end(), out.begin());
+                out.erase(end, out.end());
             } else {
-                std::vector<uint32_t> sorted(postings.begin(), postings.end());
-                std::sort(sorted.begin(), sorted.end());
-
-                std::vector<uint32_t> intersection;
-                intersection.reserve(std::min(result.size(), sorted.size()));
-                std::set_intersection(
-                    result.begin(), result.end(),
-                    sorted.begin(), sorted.end(),
-                    std::back_inserter(intersection)
-                );
-                result = std::move(intersection);
+                out.swap(ids);
+                narrowed = true;
             }
-
-            if (result.empty()) return {};
         }
+        return narrowed;
+    }
 
-        return result;
+    // Sorted union of the lists, or false if it would cover more than
+    // 1/UNION_SCAN_RATIO of the index.
+    bool unite(const std::vector<PostingList>& lists, std::vector<uint32_t>& out) const {
+        out.clear();
+        size_t total = 0;
+        for (const auto& list : lists) total += list.size();
+        if (total > index_.baseEntryCount() / UNION_SCAN_RATIO) return false;
+
+        out.reserve(total);
+        for (const auto& list : lists) list.decodeTo(out);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return true;
     }
 
     void setStatus(const std::wstring& status) {
@@ -276,23 +920,20 @@ private:
         indexStatus_ = status;
     }
 
-    static size_t findMatchPosition(std::wstring_view haystack, std::wstring_view needle) {
-        if (needle.empty()) return 0;
-        if (haystack.size() < needle.size()) return std::wstring::npos;
-
-        for (size_t i = 0; i <= haystack.size() - needle.size(); ++i) {
-            bool match = true;
-            for (size_t j = 0; j < needle.size(); ++j) {
-                if (towlower(haystack[i + j]) != towlower(needle[j])) {
-                    match = false;
-                    break;
-                }
-            }
-            if (match) return i;
-        }
-        return std::wstring::npos;
+    // a monotonic clock for streaming and save intervals
+    static uint64_t steadyMillis() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
     }
 
+    // upper bound of calculateScore: exact-length, prefix match
+    static constexpr int MAX_SCORE = 100 + 50 + 30;
+    // best calculateScore of a match past the first char, which needs a longer name
+    static constexpr int MAX_INFIX_SCORE = 100 - 1;
+
+    // a fully boosted entry gains about one word-boundary bonus
+    static constexpr int FUZZY_BOOST_SCALE = FuzzyMatcher::LENGTH_WEIGHT / 4;
+
     static int calculateScore(std::wstring_view name, std::wstring_view query, size_t matchPos) {
         int score = 100;
 
@@ -310,20 +951,44 @@ private:
         return score;
     }
 
+    static constexpr size_t MAX_RESULTS = 100;
+    // larger files are left out of content searches
+    static constexpr uint64_t MAX_CONTENT_FILE_SIZE = 64ull << 20;
+    static constexpr uint32_t SCAN_CHUNK = 16384;
+    static constexpr uint32_t CANCEL_CHECK_INTERVAL = 1024;
+    static constexpr size_t UNION_SCAN_RATIO = 2;
+    static constexpr uint64_t STREAM_INTERVAL_MS = 50;
+    static constexpr uint64_t WATCH_INTERVAL_MS = 500;
+    static constexpr uint64_t DELTA_SAVE_INTERVAL_MS = 5000;
+
     DiskIndex index_;
     mutable std::shared_mutex indexMutex_;
     mutable std::shared_mutex statusMutex_;
 
     std::thread indexThread_;
     std::thread searchThread_;
+    SearchWorkerPool searchPool_;
 
     ProgressCallback progressCallback_;
     std::wstring indexStatus_;
+    size_t indexMemoryBudget_ = 0;
+    std::atomic<bool> fuzzyMatching_{false};
+    bool liveUpdates_ = false;
+    JournalSourceFactory journalSourceFactory_;
+    QueryCache queryCache_;
+    FrecencyStore frecency_;
+
+    std::mutex watchMutex_;
+    std::condition_variable watchCv_;
 
     std::atomic<bool> indexing_{false};
     std::atomic<bool> indexReady_{false};
     std::atomic<bool> cancelIndex_{false};
     std::atomic<bool> cancelSearch_{false};
     std::atomic<uint64_t> searchId_{0};
+    std::atomic<SearchRequest*> pendingSearch_{nullptr};  // latest query not yet picked up
+    std::atomic<uint32_t> searchWake_{0};
+    std::atomic<bool> stopSearch_{false};
+    std::atomic<uint64_t> indexGeneration_{0};  // bumped whenever index_ changes
     std::atomic<float> indexProgress_{0.0f};
 };
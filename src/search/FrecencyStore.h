@@ -0,0 +1,201 @@
+#pragma once
+
+#include "IndexFormat.h"
+#include "DiskIndex.h"
+#include "MappedFile.h"
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+// How often and how recently entries were opened from search results,
+// persisted next to the index. Scores halve every two weeks without use;
+// records are keyed by ref, so they survive index rebuilds.
+//
+// Ranking never looks records up per candidate: resolve() spreads them into
+// a dense per-entry boost column for the current index, which the scan adds
+// to each score by entry index.
+class FrecencyStore {
+public:
+    // the boost column tops out here, in calculateScore points
+    static constexpr int MAX_BOOST = 30;
+
+    static std::wstring pathFor(const std::wstring& indexPath) {
+        return indexPath + L".frecency";
+    }
+
+    // Starts empty when the file is missing or damaged.
+    bool load(const std::wstring& path) {
+        std::lock_guard lock(mutex_);
+        path_ = path;
+        records_.clear();
+        dirty_ = false;
+        ++version_;
+
+        MappedFile file;
+        if (!file.open(path, MappedFile::Access::Sequential)) return false;
+
+        FrecencyHeader header{};
+        if (file.size() < sizeof(header)) return false;
+        memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != FrecencyHeader::MAGIC || header.version != FrecencyHeader::VERSION ||
+            uint64_t(header.recordCount) * sizeof(FrecencyRecord) > file.size() - sizeof(header)) {
+            return false;
+        }
+
+        records_.resize(header.recordCount);
+        memcpy(records_.data(), file.data() + sizeof(header), records_.size() * sizeof(FrecencyRecord));
+
+        // a hand-edited or torn file mustn't break the binary search
+        std::sort(records_.begin(), records_.end(),
+                  [](const FrecencyRecord& a, const FrecencyRecord& b) { return a.refKey < b.refKey; });
+        return true;
+    }
+
+    // Counts one use of the entry. Only marks the table dirty, as the UI
+    // thread calls this; saveIfDirty() writes it out later.
+    void recordUse(uint64_t refKey) {
+        std::lock_guard lock(mutex_);
+        const uint64_t now = currentTime();
+
+        auto it = std::lower_bound(records_.begin(), records_.end(), refKey,
+                                   [](const FrecencyRecord& r, uint64_t key) { return r.refKey < key; });
+        if (it == records_.end() || it->refKey != refKey) {
+            it = records_.insert(it, FrecencyRecord{ refKey, now, 0.0f, 0 });
+        }
+        it->score = static_cast<float>(decayed(*it, now) + 1.0);
+        it->lastUsed = now;
+        ++it->useCount;
+
+        prune(now);
+        ++version_;
+        dirty_ = true;
+    }
+
+    // Writes the table to the file it was loaded from if it changed since
+    // the last save. The records are copied so recordUse() isn't held up
+    // by the write; a failed save stays dirty and is retried next time.
+    bool saveIfDirty() {
+        std::lock_guard saveLock(saveMutex_);
+        std::wstring path;
+        std::vector<FrecencyRecord> records;
+        {
+            std::lock_guard lock(mutex_);
+            if (!dirty_ || path_.empty()) return true;
+            path = path_;
+            records = records_;
+            dirty_ = false;
+        }
+
+        if (save(path, records)) return true;
+
+        std::lock_guard lock(mutex_);
+        if (path_ == path) dirty_ = true;
+        return false;
+    }
+
+    // Rebuilds the boost column if the index or the records changed since
+    // the last call. Only the search thread calls this, between searches,
+    // so the column is stable while a scan reads it.
+    void resolve(const DiskIndex& index, uint64_t generation) {
+        std::lock_guard lock(mutex_);
+        if (generation == resolvedGeneration_ && version_ == resolvedVersion_) return;
+        resolvedGeneration_ = generation;
+        resolvedVersion_ = version_;
+
+        boosts_.clear();
+        maxBoost_ = 0;
+        if (records_.empty() || !index.isOpen()) return;
+
+        const uint64_t now = currentTime();
+        for (const auto& r : records_) {
+            int boost = boostFor(decayed(r, now));
+            if (boost == 0) continue;
+
+            uint32_t idx = index.findByRef(r.refKey);
+            if (idx == DiskIndex::NOT_FOUND) continue;
+
+            if (boosts_.empty()) boosts_.resize(index.entryCount());
+            boosts_[idx] = static_cast<uint8_t>(boost);
+            maxBoost_ = std::max(maxBoost_, boost);
+        }
+    }
+
+    // Per-entry boost from the last resolve(), or null when no entry has one.
+    const uint8_t* boosts() const { return boosts_.empty() ? nullptr : boosts_.data(); }
+    int maxBoost() const { return maxBoost_; }
+
+private:
+    static constexpr double HALF_LIFE_SECONDS = 14.0 * 24 * 60 * 60;
+    // a use doubling the score is worth this many points
+    static constexpr double BOOST_PER_DOUBLING = 10.0;
+    // records that have decayed below this no longer earn a boost
+    static constexpr double MIN_SCORE = 0.05;
+    static constexpr size_t MAX_RECORDS = 4096;
+
+    static uint64_t currentTime() {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+    }
+
+    static double decayed(const FrecencyRecord& r, uint64_t now) {
+        double age = now > r.lastUsed ? static_cast<double>(now - r.lastUsed) : 0.0;
+        return r.score * std::exp2(-age / HALF_LIFE_SECONDS);
+    }
+
+    static int boostFor(double score) {
+        if (score < MIN_SCORE) return 0;
+        return std::min(MAX_BOOST, static_cast<int>(BOOST_PER_DOUBLING * std::log2(1.0 + score) + 0.5));
+    }
+
+    // drops what has decayed away, then the weakest records past MAX_RECORDS
+    void prune(uint64_t now) {
+        std::erase_if(records_, [&](const FrecencyRecord& r) { return decayed(r, now) < MIN_SCORE; });
+        if (records_.size() <= MAX_RECORDS) return;
+
+        std::vector<FrecencyRecord> kept = records_;
+        std::nth_element(kept.begin(), kept.begin() + MAX_RECORDS, kept.end(),
+                         [&](const FrecencyRecord& a, const FrecencyRecord& b) {
+                             return decayed(a, now) > decayed(b, now);
+                         });
+        kept.resize(MAX_RECORDS);
+        std::sort(kept.begin(), kept.end(),
+                  [](const FrecencyRecord& a, const FrecencyRecord& b) { return a.refKey < b.refKey; });
+        records_ = std::move(kept);
+    }
+
+    static bool save(const std::wstring& path, const std::vector<FrecencyRecord>& records) {
+        FrecencyHeader header{};
+        header.magic = FrecencyHeader::MAGIC;
+        header.version = FrecencyHeader::VERSION;
+        header.recordCount = static_cast<uint32_t>(records.size());
+
+        std::wstring tempPath = path + L".tmp";
+
+        FileWriter out;
+        if (!out.create(tempPath)) return false;
+
+        out.write(&header, sizeof(header));
+        out.write(records.data(), records.size() * sizeof(FrecencyRecord));
+
+        if (!out.close()) {
+            FileWriter::remove(tempPath);
+            return false;
+        }
+        if (FileWriter::replace(tempPath, path)) return true;
+        FileWriter::remove(tempPath);
+        return false;
+    }
+
+    mutable std::mutex mutex_;
+    std::mutex saveMutex_;  // one write at a time, outside mutex_
+    std::wstring path_;
+    std::vector<FrecencyRecord> records_;  // sorted by refKey
+    uint64_t version_ = 0;                 // bumped whenever records_ changes
+    bool dirty_ = false;                   // records_ changed since the last save
+
+    std::vector<uint8_t> boosts_;
+    int maxBoost_ = 0;
+    uint64_t resolvedGeneration_ = UINT64_MAX;
+    uint64_t resolvedVersion_ = UINT64_MAX;
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "CaseFold.h"
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bit>
+#include <algorithm>
+
+#if !defined(VELOCITTY_SIMD_SSE2) && (defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__))
+#include <immintrin.h>
+#define VELOCITTY_SIMD_SSE2 1
+#endif
+
+struct FuzzyMatch {
+    int score = 0;
+    uint32_t start = 0;  // matched window in the name, for highlighting
+    uint32_t end = 0;
+};
+
+// fzf-style subsequence matcher. A pattern matches when its characters
+// appear in order; the shortest window ending at the first complete match
+// is scored, rewarding consecutive runs and characters that start a word
+// (after a separator, space or path delimiter, or a camelCase / digit
+// transition) and penalising gaps. Characters are compared against the
+// index's pre-folded copy of the name; the original only drives the bonuses.
+class FuzzyMatcher {
+public:
+    static constexpr int SCORE_MATCH = 16;
+    static constexpr int SCORE_GAP_START = -3;
+    static constexpr int SCORE_GAP_EXTENSION = -1;
+    static constexpr int BONUS_BOUNDARY = SCORE_MATCH / 2;
+    static constexpr int BONUS_BOUNDARY_WHITE = BONUS_BOUNDARY + 2;
+    static constexpr int BONUS_BOUNDARY_DELIMITER = BONUS_BOUNDARY + 1;
+    static constexpr int BONUS_NON_WORD = SCORE_MATCH / 2;
+    static constexpr int BONUS_CAMEL_123 = BONUS_BOUNDARY + SCORE_GAP_EXTENSION;
+    static constexpr int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+    static constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+    // equal scores prefer shorter names
+    static constexpr int LENGTH_WEIGHT = 64;
+
+    FuzzyMatcher() = default;
+    explicit FuzzyMatcher(std::wstring_view pattern) {
+        pattern_.reserve(pattern.size());
+        for (wchar_t c : pattern) {
+            pattern_.push_back(CaseFold::fold(c));
+        }
+    }
+
+    bool empty() const { return pattern_.empty(); }
+
+    // upper bound of any score this pattern can produce
+    int maxScore() const {
+        int m = static_cast<int>(pattern_.size());
+        if (m == 0) return 0;
+        return (m * SCORE_MATCH + (m + BONUS_FIRST_CHAR_MULTIPLIER - 1) * BONUS_BOUNDARY_WHITE) * LENGTH_WEIGHT;
+    }
+
+    // folded is CaseFold applied to text
+    bool match(std::wstring_view text, std::wstring_view folded, FuzzyMatch& out) const {
+        if (pattern_.empty()) {
+            out = {};
+            return true;
+        }
+
+        // forward: earliest position where the whole pattern has been seen
+        size_t pos = 0;
+        size_t first = 0;
+        for (size_t p = 0; p < pattern_.size(); ++p) {
+            pos = findNext(folded, pos, pattern_[p]);
+            if (pos == std::wstring_view::npos) return false;
+            if (p == 0) first = pos;
+            ++pos;
+        }
+        size_t end = pos;
+
+        // backward: latest start that still matches, i.e. the shortest window
+        size_t start = end;
+        size_t p = pattern_.size();
+        while (p > 0 && start > first) {
+            --start;
+            if (folded[start] == pattern_[p - 1]) --p;
+        }
+
+        out.start = static_cast<uint32_t>(start);
+        out.end = static_cast<uint32_t>(end);
+        out.score = weigh(scoreWindow(text, folded, start, end), text.size());
+        return true;
+    }
+
+    // Contiguous match of the whole pattern, scored like a fuzzy window.
+    bool matchExact(std::wstring_view text, std::wstring_view folded, FuzzyMatch& out) const {
+        if (pattern_.empty()) {
+            out = {};
+            return true;
+        }
+
+        size_t pos = folded.find(pattern_);
+        if (pos == std::wstring_view::npos) return false;
+
+        out.start = static_cast<uint32_t>(pos);
+        out.end = static_cast<uint32_t>(pos + pattern_.size());
+        out.score = weigh(scoreWindow(text, folded, pos, out.end), text.size());
+        return true;
+    }
+
+private:
+    enum class CharClass : uint8_t { White, NonWord, Delimiter, Lower, Upper, Letter, Number };
+
+    static CharClass classOf(wchar_t c) {
+        if (c < 0x80) {
+            if (c >= L'a' && c <= L'z') return CharClass::Lower;
+            if (c >= L'A' && c <= L'Z') return CharClass::Upper;
+            if (c >= L'0' && c <= L'9') return CharClass::Number;
+            if (c == L' ' || c == L'\t') return CharClass::White;
+            if (c == L'\\' || c == L'/' || c == L':' || c == L';' || c == L',' || c == L'|') {
+                return CharClass::Delimiter;
+            }
+            return CharClass::NonWord;
+        }
+        if (iswlower(c)) return CharClass::Lower;
+        if (iswupper(c)) return CharClass::Upper;
+        if (iswdigit(c)) return CharClass::Number;
+        if (iswalpha(c)) return CharClass::Letter;
+        if (iswspace(c)) return CharClass::White;
+        return CharClass::NonWord;
+    }
+
+    static int bonusFor(CharClass prev, CharClass cls) {
+        bool word = cls >= CharClass::Lower;
+        if (word) {
+            if (prev == CharClass::White) return BONUS_BOUNDARY_WHITE;
+            if (prev == CharClass::Delimiter) return BONUS_BOUNDARY_DELIMITER;
+            if (prev == CharClass::NonWord) return BONUS_BOUNDARY;
+        }
+        if ((prev == CharClass::Lower && cls == CharClass::Upper) ||
+            (prev != CharClass::Number && cls == CharClass::Number)) {
+            return BONUS_CAMEL_123;
+        }
+        if (cls == CharClass::NonWord || cls == CharClass::Delimiter) return BONUS_NON_WORD;
+        if (cls == CharClass::White) return BONUS_BOUNDARY_WHITE;
+        return 0;
+    }
+
+    int scoreWindow(std::wstring_view text, std::wstring_view folded, size_t start, size_t end) const {
+        int score = 0;
+        int consecutive = 0;
+        int firstBonus = 0;
+        bool inGap = false;
+        size_t p = 0;
+        CharClass prev = start > 0 ? classOf(text[start - 1]) : CharClass::White;
+
+        for (size_t i = start; i < end; ++i) {
+            wchar_t c = text[i];
+            CharClass cls = classOf(c);
+
+            if (p < pattern_.size() && folded[i] == pattern_[p]) {
+                score += SCORE_MATCH;
+                int bonus = bonusFor(prev, cls);
+                if (consecutive == 0) {
+                    firstBonus = bonus;
+                } else {
+                    // a run keeps the bonus of the boundary that started it
+                    if (bonus >= BONUS_BOUNDARY && bonus > firstBonus) firstBonus = bonus;
+                    bonus = std::max({ bonus, firstBonus, BONUS_CONSECUTIVE });
+                }
+                score += (p == 0) ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus;
+                inGap = false;
+                ++consecutive;
+                ++p;
+            } else {
+                score += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+                inGap = true;
+                consecutive = 0;
+                firstBonus = 0;
+            }
+            prev = cls;
+        }
+        return score;
+    }
+
+    static int weigh(int score, size_t length) {
+        return score * LENGTH_WEIGHT - static_cast<int>(std::min<size_t>(length, LENGTH_WEIGHT - 1));
+    }
+
+    // Next position >= from holding c, eight UTF-16 units per compare.
+    static size_t findNext(std::wstring_view folded, size_t from, wchar_t c) {
+        size_t i = from;
+        const size_t n = folded.size();
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        if constexpr (sizeof(wchar_t) == 2) {
+            const __m128i target = _mm_set1_epi16(static_cast<short>(c));
+            for (; i + 8 <= n; i += 8) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(folded.data() + i));
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, target)));
+                if (mask) return i + std::countr_zero(mask) / 2;
+            }
+        }
+#endif
+
+        for (; i < n; ++i) {
+            if (folded[i] == c) return i;
+        }
+        return std::wstring_view::npos;
+    }
+
+    std::wstring pattern_;
+};
+
+// Space-separated terms that must all match, fzf style. A term starting
+// with ' must appear contiguously, which also lets the trigram index
+// narrow the candidates; every other term is a fuzzy subsequence.
+class FuzzyQuery {
+public:
+    explicit FuzzyQuery(std::wstring_view query) {
+        size_t i = 0;
+        while (i < query.size()) {
+            while (i < query.size() && query[i] == L' ') ++i;
+            size_t start = i;
+            while (i < query.size() && query[i] != L' ') ++i;
+            if (i == start) continue;
+
+            std::wstring_view term = query.substr(start, i - start);
+            bool exact = term.front() == L'\'';
+            if (exact) term.remove_prefix(1);
+            if (term.empty()) continue;
+
+            terms_.push_back({ FuzzyMatcher(term), exact });
+            if (exact) exactTerms_.push_back(term);
+        }
+    }
+
+    bool empty() const { return terms_.empty(); }
+
+    // contiguous terms, usable as a trigram prefilter when 3+ chars long
+    const std::vector<std::wstring_view>& exactTerms() const { return exactTerms_; }
+
+    int maxScore() const {
+        int total = 0;
+        for (const auto& t : terms_) total += t.matcher.maxScore();
+        return total;
+    }
+
+    // Sums the term scores; the highlighted window is the first term's.
+    bool match(std::wstring_view name, std::wstring_view folded, FuzzyMatch& out) const {
+        out = {};
+        for (size_t i = 0; i < terms_.size(); ++i) {
+            FuzzyMatch m;
+            bool ok = terms_[i].exact ? terms_[i].matcher.matchExact(name, folded, m)
+                                      : terms_[i].matcher.match(name, folded, m);
+            if (!ok) return false;
+
+            if (i == 0) {
+                out.start = m.start;
+                out.end = m.end;
+            }
+            out.score += m.score;
+        }
+        return true;
+    }
+
+private:
+    struct Term {
+        FuzzyMatcher matcher;
+        bool exact;
+    };
+
+    std::vector<Term> terms_;
+    std::vector<std::wstring_view> exactTerms_;  // views into the query
+};
@@ -1,20 +1,26 @@
 #pragma once
 
-#include "../../framework.h"
 #include "DiskIndex.h"
+#ifdef _WIN32
 #include "MftEnumerator.h"
+#include "UsnJournalSource.h"
+#else
+#include "PosixEnumerator.h"
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <mntent.h>
+#endif
+#endif
 #include <map>
-#include <set>
-
-#pragma pack(push, 1)
-struct DriveMetadata {
-    wchar_t driveLetter;
-    uint8_t padding[2];
-    uint32_t volumeSerial;
-    uint64_t lastUsn;
-    uint64_t journalId;
-};
-#pragma pack(pop)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 class IndexBuilder {
 public:
@@ -26,210 +32,279 @@ public:
         uint32_t filesRemoved = 0;
         uint32_t trigramsCreated = 0;
         bool wasIncremental = false;
+        bool indexWritten = false;  // a new base replaced the index file
+        bool writeFailed = false;   // the index or its delta couldn't be saved; the files are as they were
     };
 
     IndexBuilder() = default;
 
+    // 0 builds every posting list in memory. Otherwise postings are produced
+    // by an external sort: sorted runs that fit the budget are spilled next
+    // to the output and k-way merged straight into the index file.
+    void setMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+
     BuildStats build(const std::wstring& outputPath, std::atomic<bool>& cancel,
                      ProgressCallback progress = nullptr) {
         BuildStats stats;
 
         entries_.clear();
+        sizes_.clear();
+        modifiedTimes_.clear();
         stringPool_.clear();
-        trigramPostings_.clear();
-        shortNames_.clear();
+        parentIndex_.clear();
+        refToIndex_.clear();
         driveMetadata_.clear();
 
-        stringPool_.reserve(2 * 1024 * 1024);
-        entries_.reserve(1000000);
-
         if (progress) progress(0.0f, L"Scanning drives...");
 
-        DWORD drives = GetLogicalDrives();
-        std::vector<int> fixedDrives;
+        std::vector<VolumeScan> scans = findVolumes();
 
-        for (int i = 0; i < 26; ++i) {
-            if (!(drives & (1 << i))) continue;
-            wchar_t root[4] = { static_cast<wchar_t>(L'A' + i), L':', L'\\', 0 };
-            if (GetDriveTypeW(root) == DRIVE_FIXED) {
-                fixedDrives.push_back(i);
-            }
-        }
+        // one enumeration worker per volume; this thread only reports progress
+        std::atomic<uint32_t> filesSeen{0};
+        std::atomic<uint32_t> volumesLeft{static_cast<uint32_t>(scans.size())};
+        std::vector<std::thread> workers;
+        workers.reserve(scans.size());
 
-        MftEnumerator enumerator;
-        int currentDrive = 0;
-
-        for (int driveIdx : fixedDrives) {
-            if (cancel) break;
-
-            wchar_t drive = L'A' + static_cast<wchar_t>(driveIdx);
-            uint8_t driveIndex = static_cast<uint8_t>(driveIdx);
+        for (auto& scan : scans) {
+            workers.emplace_back([this, &scan, &cancel, &filesSeen, &volumesLeft]() {
+                scanVolume(scan, cancel, filesSeen);
+                volumesLeft--;
+            });
+        }
 
-            float driveBaseProgress = static_cast<float>(currentDrive) / static_cast<float>(fixedDrives.size()) * 0.8f;
-            float driveProgressRange = 0.8f / static_cast<float>(fixedDrives.size());
-            uint32_t driveFileCount = 0;
+        std::wstring driveList;
+        for (const auto& scan : scans) {
+            if (!driveList.empty()) driveList += L", ";
+#ifdef _WIN32
+            driveList += scan.drive;
+            driveList += L":\\";
+#else
+            driveList += Utf8::decode(scan.root);
+#endif
+        }
 
+        while (volumesLeft > 0) {
             if (progress) {
-                progress(driveBaseProgress, std::wstring(L"Indexing ") + drive + L":\\ ...");
+                uint32_t seen = filesSeen.load();
+                float p = std::min(0.8f, seen / (500000.0f * std::max<size_t>(1, scans.size())) * 0.8f);
+                progress(p, L"Indexing " + driveList + L" - " + std::to_wstring(seen) + L" files...");
             }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
 
-            DriveMetadata meta{};
-            meta.driveLetter = drive;
-            meta.volumeSerial = getVolumeSerial(drive);
+        for (auto& t : workers) {
+            t.join();
+        }
 
-            enumerator.enumerateDrive(drive,
-                [&](const std::wstring& name, uint64_t ref, uint64_t parent, uint32_t attrs) {
-                    if (cancel) return;
-                    addEntry(ref, parent, name, static_cast<uint8_t>(attrs), driveIndex);
-                    stats.filesIndexed++;
-                    driveFileCount++;
+        if (cancel) return stats;
 
-                    if (progress && (driveFileCount % 5000) == 0) {
-                        float withinDrive = std::min(0.95f, driveFileCount / 500000.0f);
-                        float p = driveBaseProgress + withinDrive * driveProgressRange;
-                        progress(p, std::wstring(L"Indexing ") + drive + L":\\ - " +
-                                    std::to_wstring(driveFileCount) + L" files...");
-                    }
-                },
-                cancel
-            );
+        for (auto& scan : scans) {
+            uint32_t entryBase = static_cast<uint32_t>(entries_.size());
+            uint32_t nameBase = static_cast<uint32_t>(stringPool_.size());
 
-            // need this for incremental updates
-            captureJournalPosition(drive, meta);
-            driveMetadata_.push_back(meta);
+            for (auto e : scan.entries) {
+                e.nameOffset += nameBase;
+                entries_.push_back(e);
+            }
+            sizes_.insert(sizes_.end(), scan.sizes.begin(), scan.sizes.end());
+            modifiedTimes_.insert(modifiedTimes_.end(), scan.modifiedTimes.begin(), scan.modifiedTimes.end());
+            stringPool_.insert(stringPool_.end(), scan.names.begin(), scan.names.end());
+
+            for (uint32_t parent : scan.parents) {
+                parentIndex_.push_back(parent == DiskIndex::NO_PARENT ? parent : parent + entryBase);
+            }
 
-            currentDrive++;
+            driveMetadata_.push_back(scan.meta);
+            scan = VolumeScan{};
         }
 
-        if (cancel) return stats;
+        stats.filesIndexed = static_cast<uint32_t>(entries_.size());
 
         if (progress) progress(0.85f, L"Building trigram index...");
 
-        for (uint32_t idx = 0; idx < entries_.size(); ++idx) {
-            if (cancel) break;
-            auto name = getName(idx);
-            addTrigrams(idx, name);
+        if (!writeIndex(outputPath, cancel, stats, progress, L"Writing index file...")) {
+            stats.writeFailed = !cancel;
+            return stats;
         }
 
-        stats.trigramsCreated = static_cast<uint32_t>(trigramPostings_.size());
-
-        if (cancel) return stats;
-
-        if (progress) progress(0.90f, L"Writing index file...");
-
-        writeToFile(outputPath);
-
         if (progress) progress(1.0f, L"Complete");
 
         stats.filesAdded = stats.filesIndexed;
+        stats.indexWritten = true;
         return stats;
     }
 
+    // Applies journal changes to the index's delta segment, so an update
+    // costs time proportional to the number of changes. The base file is
+    // only rewritten once the delta grows past compactionThreshold.
+    //
+    // Windows only: the changes come from the volumes' USN journals, and
+    // POSIX has no journal source to catch up from, so there this always
+    // does a full build() and the result has wasIncremental unset.
     BuildStats incrementalUpdate(const std::wstring& indexPath, std::atomic<bool>& cancel,
                                   ProgressCallback progress = nullptr) {
         BuildStats stats;
         stats.wasIncremental = true;
 
-        if (!loadExistingMetadata(indexPath)) {
+        DiskIndex base;
+        if (!base.open(indexPath)) {
             return build(indexPath, cancel, progress);
         }
 
+#ifndef _WIN32
+        // no change journal to catch up from; see above
+        base.close();
+        return build(indexPath, cancel, progress);
+#else
         if (progress) progress(0.0f, L"Checking for changes...");
 
-        std::vector<uint64_t> deletedRefs;
-        std::vector<FileChange> addedFiles;
-
-        int driveIdx = 0;
-        for (auto& meta : driveMetadata_) {
-            if (cancel) break;
-
-            if (progress) {
-                float p = static_cast<float>(driveIdx) / static_cast<float>(driveMetadata_.size());
-                progress(p * 0.5f, std::wstring(L"Scanning changes on ") + meta.driveLetter + L":\\");
-            }
+        UsnJournalSource journal(base.driveMetadata());
+        std::vector<JournalChange> changes;
 
-            queryJournalChanges(meta, deletedRefs, addedFiles, cancel,
-                                static_cast<uint8_t>(meta.driveLetter - L'A'));
-            driveIdx++;
+        if (!journal.read(changes, cancel)) {
+            base.close();
+            if (progress) progress(0.0f, L"Change journal was reset, rebuilding...");
+            return build(indexPath, cancel, progress);
         }
 
         if (cancel) return stats;
 
-        size_t totalChanges = deletedRefs.size() + addedFiles.size();
-        if (totalChanges > entries_.size() / 4) {
+        if (changes.size() > base.baseEntryCount() / 4) {
+            base.close();
             if (progress) progress(0.0f, L"Many changes detected, rebuilding...");
             return build(indexPath, cancel, progress);
         }
 
-        if (totalChanges == 0) {
+        if (changes.empty()) {
             if (progress) progress(1.0f, L"Index is up to date");
             return stats;
         }
 
         if (progress) progress(0.6f, L"Applying changes...");
 
-        std::set<uint64_t> deletedSet(deletedRefs.begin(), deletedRefs.end());
-        for (auto it = refToIndex_.begin(); it != refToIndex_.end(); ) {
-            if (deletedSet.count(it->first)) {
-                uint32_t idx = it->second;
-                removeTrigrams(idx);
-                entries_[idx].fileRef = 0;  // mark as deleted
-                stats.filesRemoved++;
-                it = refToIndex_.erase(it);
-            } else {
-                ++it;
+        // the positions reach disk only with the changes read up to them,
+        // so if nothing can be written the next update reads them again
+        auto applied = base.applyChanges(changes);
+        base.recordPositions(journal.positions());
+
+        if (!needsCompaction(base)) {
+            if (progress) progress(0.9f, L"Writing changes...");
+            if (!base.delta().save(DeltaSegment::pathFor(indexPath))) {
+                stats.writeFailed = true;
+                return stats;
             }
+            stats.filesAdded = applied.added;
+            stats.filesRemoved = applied.removed;
+            stats.filesIndexed = base.entryCount() - base.delta().tombstoneCount();
+            if (progress) progress(1.0f, L"Update complete");
+            return stats;
         }
 
-        for (const auto& change : addedFiles) {
-            if (cancel) break;
+        if (progress) progress(0.7f, L"Compacting index...");
+
+        loadCompacted(base);
+        base.close();
 
-            uint8_t driveIndex = static_cast<uint8_t>(change.driveLetter - L'A');
-            uint32_t idx = addEntry(change.fileRef, change.parentRef, change.name,
-                                    static_cast<uint8_t>(change.attributes), driveIndex);
-            addTrigrams(idx, change.name);
-            stats.filesAdded++;
+        if (!writeCompacted(indexPath, cancel, stats, progress)) {
+            stats.writeFailed = !cancel;
+            return stats;
         }
+        stats.filesAdded = applied.added;
+        stats.filesRemoved = applied.removed;
+        stats.indexWritten = true;
 
-        stats.filesIndexed = static_cast<uint32_t>(entries_.size());
-        stats.trigramsCreated = static_cast<uint32_t>(trigramPostings_.size());
+        if (progress) progress(1.0f, L"Update complete");
 
-        if (cancel) return stats;
+        return stats;
+#endif
+    }
 
-        if (progress) progress(0.9f, L"Writing updated index...");
+    // Compaction folds the delta into a freshly written base. It runs in two
+    // steps so a caller can stop reading its index in between: loadCompacted
+    // copies the live base and delta entries, with parents re-resolved by
+    // ref so moved directories pick up their children; writeCompacted then
+    // builds the postings and writes the new base.
+    void loadCompacted(const DiskIndex& index) {
+        entries_.clear();
+        sizes_.clear();
+        modifiedTimes_.clear();
+        stringPool_.clear();
+        refToIndex_.clear();
+        driveMetadata_ = index.driveMetadata();
 
-        for (auto& meta : driveMetadata_) {
-            captureJournalPosition(meta.driveLetter, meta);
+        uint32_t live = index.entryCount() - index.delta().tombstoneCount();
+        entries_.reserve(live);
+        refToIndex_.reserve(live);
+
+        for (uint32_t idx = 0; idx < index.entryCount(); ++idx) {
+            if (index.isDeleted(idx)) continue;
+
+            const auto& e = index.entry(idx);
+            addEntry(e.fileRef, e.parentRef, index.getName(idx), e.attributes, e.driveIndex,
+                     index.fileSize(idx), index.modifiedTime(idx));
         }
 
-        writeToFile(indexPath);
+        parentIndex_ = resolveParents();
+    }
+
+    bool writeCompacted(const std::wstring& outputPath, std::atomic<bool>& cancel, BuildStats& stats,
+                        ProgressCallback progress = nullptr) {
+        stats.filesIndexed = static_cast<uint32_t>(entries_.size());
+        return writeIndex(outputPath, cancel, stats, progress, L"Writing compacted index...");
+    }
 
-        if (progress) progress(1.0f, L"Update complete");
+    using AddEntry = std::function<void(uint64_t fileRef, uint64_t parentRef, std::wstring_view name,
+                                        uint8_t attributes, uint8_t driveIndex, uint64_t size,
+                                        uint32_t modifiedTime)>;
+
+    // Writes an index of entries supplied by produce instead of a drive scan,
+    // e.g. a synthetic tree for benchmarks. Parents are resolved by ref once
+    // every entry is in, so entries may come in any order.
+    BuildStats buildFrom(const std::function<void(const AddEntry&)>& produce, const std::wstring& outputPath,
+                         std::atomic<bool>& cancel) {
+        BuildStats stats;
+
+        entries_.clear();
+        sizes_.clear();
+        modifiedTimes_.clear();
+        stringPool_.clear();
+        refToIndex_.clear();
+        driveMetadata_.clear();
 
+        produce([this](uint64_t fileRef, uint64_t parentRef, std::wstring_view name, uint8_t attributes,
+                       uint8_t driveIndex, uint64_t size, uint32_t modifiedTime) {
+            addEntry(fileRef, parentRef, name, attributes, driveIndex, size, modifiedTime);
+        });
+        parentIndex_ = resolveParents();
+
+        stats.filesIndexed = static_cast<uint32_t>(entries_.size());
+        if (writeIndex(outputPath, cancel, stats, nullptr, L"")) {
+            stats.filesAdded = stats.filesIndexed;
+            stats.indexWritten = true;
+        } else {
+            stats.writeFailed = !cancel;
+        }
         return stats;
     }
 
-    static bool needsRebuild(const std::wstring& indexPath) {
-        DiskIndex existing;
-        if (!existing.open(indexPath)) return true;
-
-        uint64_t age = GetTickCount64() - existing.buildTimestamp();
-        constexpr uint64_t MAX_AGE_MS = 7 * 24 * 60 * 60 * 1000;  // 7 days
+    static bool needsCompaction(const DiskIndex& index) {
+        return index.delta().changeCount() > compactionThreshold(index.baseEntryCount());
+    }
 
-        return age > MAX_AGE_MS;
+    // Delta size (added + tombstoned entries) beyond which it is folded into
+    // a freshly written base.
+    static size_t compactionThreshold(uint32_t baseEntryCount) {
+        return std::max<size_t>(MIN_COMPACTION_CHANGES, baseEntryCount / 64);
     }
 
 private:
-    struct FileChange {
-        wchar_t driveLetter;
-        uint64_t fileRef;
-        uint64_t parentRef;
-        std::wstring name;
-        uint32_t attributes;
-    };
+    static constexpr size_t MIN_COMPACTION_CHANGES = 16384;
+    static constexpr size_t MAX_VOLUMES = 26;
 
-    uint32_t addEntry(uint64_t fileRef, uint64_t parentRef, const std::wstring& name,
-                      uint8_t attributes, uint8_t driveIndex) {
+    uint32_t addEntry(uint64_t fileRef, uint64_t parentRef, std::wstring_view name,
+                      uint8_t attributes, uint8_t driveIndex,
+                      uint64_t size = FileMetadata::UNKNOWN_SIZE,
+                      uint32_t modifiedTime = FileMetadata::UNKNOWN_TIME) {
         uint32_t idx = static_cast<uint32_t>(entries_.size());
         uint32_t nameOffset = static_cast<uint32_t>(stringPool_.size());
         uint16_t nameLen = static_cast<uint16_t>(std::min(name.length(), size_t(UINT16_MAX)));
@@ -245,6 +320,8 @@ private:
         entry.driveIndex = driveIndex;
 
         entries_.push_back(entry);
+        sizes_.push_back(size);
+        modifiedTimes_.push_back(modifiedTime);
 
         uint64_t key = makeRefKey(driveIndex, fileRef);
         refToIndex_[key] = idx;
@@ -261,270 +338,825 @@ private:
         return { stringPool_.data() + e.nameOffset, e.nameLength };
     }
 
-    void addTrigrams(uint32_t fileIndex, std::wstring_view name) {
-        if (name.size() < 3) {
-            shortNames_.push_back(fileIndex);
-            return;
-        }
+    std::wstring_view getFoldedName(uint32_t idx) const {
+        const auto& e = entries_[idx];
+        return { foldedPool_.data() + e.nameOffset, e.nameLength };
+    }
 
-        for (size_t i = 0; i + 2 < name.size(); ++i) {
-            uint32_t tri = DiskIndex::makeTrigram(name[i], name[i + 1], name[i + 2]);
-            trigramPostings_[tri].push_back(fileIndex);
+    struct VolumeScan {
+        wchar_t drive = 0;
+        uint8_t driveIndex = 0;
+#ifndef _WIN32
+        std::string root;  // mount point
+#endif
+        DriveMetadata meta{};
+        std::vector<DiskFileEntry> entries;
+        std::vector<uint64_t> sizes;
+        std::vector<uint32_t> modifiedTimes;
+        std::vector<wchar_t> names;
+        std::vector<uint32_t> parents;  // volume-local entry indices
+    };
+
+    // Posting lists in final on-disk order, ready to be written.
+    struct PostingLayout {
+        std::vector<DiskTrigramEntry> trigrams;
+        std::vector<DiskPostingBlock> blocks;
+        std::vector<uint32_t> words;
+    };
+
+#ifdef _WIN32
+    // every fixed drive, by letter
+    static std::vector<VolumeScan> findVolumes() {
+        DWORD drives = GetLogicalDrives();
+        std::vector<VolumeScan> scans;
+
+        for (int i = 0; i < 26; ++i) {
+            if (!(drives & (1 << i))) continue;
+            wchar_t root[4] = { static_cast<wchar_t>(L'A' + i), L':', L'\\', 0 };
+            if (GetDriveTypeW(root) == DRIVE_FIXED) {
+                VolumeScan scan;
+                scan.drive = static_cast<wchar_t>(L'A' + i);
+                scan.driveIndex = static_cast<uint8_t>(i);
+                scans.push_back(std::move(scan));
+            }
         }
+        return scans;
     }
 
-    void removeTrigrams(uint32_t fileIndex) {
-        auto name = getName(fileIndex);
-        if (name.size() < 3) {
-            auto it = std::find(shortNames_.begin(), shortNames_.end(), fileIndex);
-            if (it != shortNames_.end()) shortNames_.erase(it);
-            return;
+    void scanVolume(VolumeScan& scan, std::atomic<bool>& cancel, std::atomic<uint32_t>& filesSeen) {
+        scan.meta.driveLetter = scan.drive;
+        scan.meta.volumeSerial = getVolumeSerial(scan.drive);
+        scan.entries.reserve(500000);
+        scan.names.reserve(2 * 1024 * 1024);
+
+        MftEnumerator enumerator;
+        enumerator.enumerateDrive(scan.drive,
+            [&](const std::wstring& name, uint64_t ref, uint64_t parent, uint32_t attrs, uint64_t size,
+                uint32_t modifiedTime) {
+                if (cancel) return;
+                appendScanEntry(scan, name, ref, parent, attrs, size, modifiedTime);
+                filesSeen.fetch_add(1, std::memory_order_relaxed);
+            },
+            cancel
+        );
+
+        // need this for incremental updates
+        UsnJournalSource::capturePosition(scan.drive, scan.meta);
+
+        if (cancel) return;
+        resolveScanParents(scan);
+    }
+#else
+    // "/" and every other mounted block device, each once however often
+    // it is mounted, up to one per drive index a letter would have had.
+    static std::vector<VolumeScan> findVolumes() {
+        std::vector<std::string> roots = { "/" };
+#if defined(__linux__)
+        if (FILE* mounts = setmntent("/proc/self/mounts", "r")) {
+            while (mntent* m = getmntent(mounts)) {
+                // squashfs images (snaps) are block devices too, but read-only packages
+                if (strncmp(m->mnt_fsname, "/dev/", 5) != 0 || strcmp(m->mnt_type, "squashfs") == 0) continue;
+                roots.push_back(m->mnt_dir);
+            }
+            endmntent(mounts);
         }
+#endif
+
+        std::vector<VolumeScan> scans;
+        std::vector<dev_t> devices;
+        for (const auto& root : roots) {
+            struct stat st;
+            if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+            if (std::find(devices.begin(), devices.end(), st.st_dev) != devices.end()) continue;
+            if (scans.size() == MAX_VOLUMES) break;
+            devices.push_back(st.st_dev);
+
+            VolumeScan scan;
+            scan.driveIndex = static_cast<uint8_t>(scans.size());
+            scan.drive = static_cast<wchar_t>(L'A' + scan.driveIndex);
+            scan.root = root;
+            scan.meta.volumeSerial = static_cast<uint32_t>(st.st_dev);
+            scans.push_back(std::move(scan));
+        }
+        return scans;
+    }
 
-        for (size_t i = 0; i + 2 < name.size(); ++i) {
-            uint32_t tri = DiskIndex::makeTrigram(name[i], name[i + 1], name[i + 2]);
-            auto& list = trigramPostings_[tri];
-            auto it = std::find(list.begin(), list.end(), fileIndex);
-            if (it != list.end()) list.erase(it);
+    // One mounted filesystem from its mount point, inode numbers standing
+    // in for NTFS file refs. Below "/" the mount point itself heads the
+    // scan as a top-level directory named by its whole path ("mnt/data"),
+    // since the filesystem it sits in doesn't report it.
+    void scanVolume(VolumeScan& scan, std::atomic<bool>& cancel, std::atomic<uint32_t>& filesSeen) {
+        scan.meta.driveLetter = scan.drive;
+
+        struct stat st;
+        if (scan.root != "/" && stat(scan.root.c_str(), &st) == 0) {
+            uint32_t modifiedTime = st.st_mtime > 0 ? static_cast<uint32_t>(std::min<int64_t>(st.st_mtime, UINT32_MAX))
+                                                    : FileMetadata::UNKNOWN_TIME;
+            appendScanEntry(scan, Utf8::decode(scan.root.substr(1)), st.st_ino, 0, FileAttributes::DIRECTORY,
+                            FileMetadata::UNKNOWN_SIZE, modifiedTime);
         }
+
+        // the size and time columns need a stat per file, which the walk
+        // otherwise skips for anything but directories
+        PosixEnumerator enumerator;
+        enumerator.setReadMetadata(true);
+        enumerator.enumerate(scan.root,
+            [&](const std::wstring& name, uint64_t ref, uint64_t parent, uint32_t attrs, uint64_t size,
+                uint32_t modifiedTime) {
+                if (cancel) return;
+                appendScanEntry(scan, name, ref, parent, attrs, size, modifiedTime);
+                filesSeen.fetch_add(1, std::memory_order_relaxed);
+            },
+            cancel
+        );
+
+        if (cancel) return;
+        resolveScanParents(scan);
     }
+#endif
 
-    void writeToFile(const std::wstring& path) {
-        std::vector<std::pair<uint32_t, std::vector<uint32_t>>> sortedTrigrams;
-        sortedTrigrams.reserve(trigramPostings_.size() + 1);
+    static void appendScanEntry(VolumeScan& scan, const std::wstring& name, uint64_t ref, uint64_t parent,
+                                uint32_t attrs, uint64_t size, uint32_t modifiedTime) {
+        uint16_t nameLen = static_cast<uint16_t>(std::min(name.length(), size_t(UINT16_MAX)));
+
+        DiskFileEntry entry{};
+        entry.fileRef = ref;
+        entry.parentRef = parent;
+        entry.nameOffset = static_cast<uint32_t>(scan.names.size());
+        entry.nameLength = nameLen;
+        entry.attributes = static_cast<uint8_t>(attrs);
+        entry.driveIndex = scan.driveIndex;
+        scan.entries.push_back(entry);
+        scan.sizes.push_back(size);
+        scan.modifiedTimes.push_back(modifiedTime);
 
-        if (!shortNames_.empty()) {
-            std::sort(shortNames_.begin(), shortNames_.end());
-            sortedTrigrams.emplace_back(0, shortNames_);
+        scan.names.insert(scan.names.end(), name.begin(), name.begin() + nameLen);
+    }
+
+    // parents never cross volumes, so each worker resolves its own
+    static void resolveScanParents(VolumeScan& scan) {
+        std::unordered_map<uint64_t, uint32_t> refToLocal;
+        refToLocal.reserve(scan.entries.size());
+        for (uint32_t i = 0; i < scan.entries.size(); ++i) {
+            refToLocal[scan.entries[i].fileRef] = i;
         }
 
-        for (auto& [tri, list] : trigramPostings_) {
-            if (!list.empty()) {
-                std::sort(list.begin(), list.end());
-                sortedTrigrams.emplace_back(tri, std::move(list));
+        scan.parents.assign(scan.entries.size(), DiskIndex::NO_PARENT);
+        for (uint32_t i = 0; i < scan.entries.size(); ++i) {
+            auto it = refToLocal.find(scan.entries[i].parentRef);
+            if (it != refToLocal.end() && it->second != i) {
+                scan.parents[i] = it->second;
             }
         }
+    }
 
-        std::sort(sortedTrigrams.begin(), sortedTrigrams.end(),
-            [](const auto& a, const auto& b) { return a.first < b.first; });
+    static uint32_t workerCount() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
 
-        std::vector<DiskTrigramEntry> trigramEntries;
-        std::vector<uint32_t> allPostings;
-        trigramEntries.reserve(sortedTrigrams.size());
+    // Runs fn(0..count-1) across up to `workers` threads, the caller included.
+    template <typename Fn>
+    static void parallelFor(size_t count, uint32_t workers, Fn&& fn) {
+        std::atomic<size_t> next{0};
+        auto run = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                fn(i);
+            }
+        };
 
-        for (const auto& [tri, list] : sortedTrigrams) {
-            DiskTrigramEntry te{};
-            te.trigram = tri;
-            te.postingOffset = static_cast<uint32_t>(allPostings.size());
-            te.postingCount = static_cast<uint32_t>(list.size());
-            trigramEntries.push_back(te);
-            allPostings.insert(allPostings.end(), list.begin(), list.end());
+        std::vector<std::thread> threads;
+        size_t extra = std::min<size_t>(workers, count);
+        for (size_t t = 1; t < extra; ++t) {
+            threads.emplace_back(run);
+        }
+        run();
+        for (auto& t : threads) {
+            t.join();
         }
+    }
 
-        DiskIndexHeader header{};
-        header.magic = DiskIndexHeader::MAGIC;
-        header.version = DiskIndexHeader::VERSION;
-        header.entryCount = static_cast<uint32_t>(entries_.size());
-        header.stringPoolSize = static_cast<uint32_t>(stringPool_.size());
-        header.trigramCount = static_cast<uint32_t>(trigramEntries.size());
-        header.postingDataSize = static_cast<uint32_t>(allPostings.size());
-        header.buildTimestamp = GetTickCount64();
+    // Every posting key of a folded name: its trigrams, its bigrams and the
+    // bucket of its first char (see DiskIndex::makeBigram).
+    template <typename Emit>
+    static void forEachKey(std::wstring_view name, Emit&& emit) {
+        if (name.empty()) return;
+        emit(DiskIndex::makeFirstCharKey(name[0]));
+        for (size_t i = 0; i + 1 < name.size(); ++i) {
+            emit(DiskIndex::makeBigram(name[i], name[i + 1]));
+        }
+        for (size_t i = 0; i + 2 < name.size(); ++i) {
+            emit(DiskIndex::makeTrigram(name[i], name[i + 1], name[i + 2]));
+        }
+    }
 
-        std::wstring tempPath = path + L".tmp";
+    static uint32_t shardOf(uint32_t trigram, uint32_t shardCount) {
+        return static_cast<uint32_t>((static_cast<uint64_t>(trigram * 2654435761u) * shardCount) >> 32);
+    }
 
-        HANDLE hFile = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0,
-                                   nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-        if (hFile == INVALID_HANDLE_VALUE) return;
+    // Builds every posting list in three parallel passes without a global
+    // trigram map:
+    //  1. entry chunks emit (trigram, index) pairs into per-shard buckets
+    //  2. each shard sorts its pairs and encodes its lists on its own
+    //  3. shards hold disjoint trigram sets and are merged in trigram order
+    PostingLayout buildPostings(std::atomic<bool>& cancel) const {
+        PostingLayout layout;
+
+        const uint32_t workers = workerCount();
+        const uint32_t shardCount = workers * 4;
+        const size_t entryCount = entries_.size();
+        const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(workers * 4, entryCount));
+        const size_t chunkSize = (entryCount + chunkCount - 1) / chunkCount;
+
+        std::vector<std::vector<std::vector<uint64_t>>> emitted(
+            chunkCount, std::vector<std::vector<uint64_t>>(shardCount));
+
+        parallelFor(chunkCount, workers, [&](size_t chunk) {
+            auto& buckets = emitted[chunk];
+            size_t end = std::min(entryCount, (chunk + 1) * chunkSize);
+
+            for (size_t idx = chunk * chunkSize; idx < end && !cancel; ++idx) {
+                if (entries_[idx].fileRef == 0) continue;  // deleted entry
+
+                forEachKey(getFoldedName(static_cast<uint32_t>(idx)), [&](uint32_t key) {
+                    buckets[shardOf(key, shardCount)].push_back((static_cast<uint64_t>(key) << 32) | idx);
+                });
+            }
+        });
 
-        DWORD written;
-        WriteFile(hFile, &header, sizeof(header), &written, nullptr);
-        WriteFile(hFile, entries_.data(), entries_.size() * sizeof(DiskFileEntry), &written, nullptr);
-        WriteFile(hFile, stringPool_.data(), stringPool_.size() * sizeof(wchar_t), &written, nullptr);
-        WriteFile(hFile, trigramEntries.data(), trigramEntries.size() * sizeof(DiskTrigramEntry), &written, nullptr);
-        WriteFile(hFile, allPostings.data(), allPostings.size() * sizeof(uint32_t), &written, nullptr);
+        if (cancel) return layout;
 
-        uint32_t metaCount = static_cast<uint32_t>(driveMetadata_.size());
-        WriteFile(hFile, &metaCount, sizeof(metaCount), &written, nullptr);
-        WriteFile(hFile, driveMetadata_.data(), driveMetadata_.size() * sizeof(DriveMetadata), &written, nullptr);
+        std::vector<PostingLayout> shards(shardCount);
+
+        parallelFor(shardCount, workers, [&](size_t shard) {
+            size_t total = 0;
+            for (size_t c = 0; c < chunkCount; ++c) {
+                total += emitted[c][shard].size();
+            }
 
-        CloseHandle(hFile);
+            std::vector<uint64_t> pairs;
+            pairs.reserve(total);
+            for (size_t c = 0; c < chunkCount; ++c) {
+                auto& bucket = emitted[c][shard];
+                pairs.insert(pairs.end(), bucket.begin(), bucket.end());
+                std::vector<uint64_t>().swap(bucket);
+            }
 
-        DeleteFileW(path.c_str());
-        MoveFileW(tempPath.c_str(), path.c_str());
-    }
+            // a name can repeat a trigram; the codec needs strictly increasing ids
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+            auto& out = shards[shard];
+            std::vector<uint32_t> list;
+            for (size_t i = 0; i < pairs.size() && !cancel; ) {
+                uint32_t tri = static_cast<uint32_t>(pairs[i] >> 32);
+                list.clear();
+                for (; i < pairs.size() && static_cast<uint32_t>(pairs[i] >> 32) == tri; ++i) {
+                    list.push_back(static_cast<uint32_t>(pairs[i]));
+                }
 
-    bool loadExistingMetadata(const std::wstring& path) {
-        HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
-                                   nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-        if (hFile == INVALID_HANDLE_VALUE) return false;
+                DiskTrigramEntry te{};
+                te.trigram = tri;
+                te.firstBlock = static_cast<uint32_t>(out.blocks.size());
+                te.postingCount = static_cast<uint32_t>(list.size());
+                out.trigrams.push_back(te);
+                PostingCodec::encode(list, out.blocks, out.words);
+            }
+        });
 
-        LARGE_INTEGER fileSize;
-        GetFileSizeEx(hFile, &fileSize);
+        if (cancel) return layout;
 
-        DiskIndexHeader header{};
-        DWORD read;
-        ReadFile(hFile, &header, sizeof(header), &read, nullptr);
+        size_t trigramTotal = 0;
+        size_t blockTotal = 0;
+        size_t wordTotal = 0;
+        for (const auto& shard : shards) {
+            trigramTotal += shard.trigrams.size();
+            blockTotal += shard.blocks.size();
+            wordTotal += shard.words.size();
+        }
+        layout.trigrams.reserve(trigramTotal);
+        layout.blocks.reserve(blockTotal);
+        layout.words.reserve(wordTotal);
+
+        // packed words are addressed through the blocks, so shards can be
+        // appended whole; only the directory and blocks need trigram order
+        std::vector<uint32_t> wordBase(shardCount);
+        for (uint32_t s = 0; s < shardCount; ++s) {
+            wordBase[s] = static_cast<uint32_t>(layout.words.size());
+            layout.words.insert(layout.words.end(), shards[s].words.begin(), shards[s].words.end());
+            std::vector<uint32_t>().swap(shards[s].words);
+        }
 
-        if (header.magic != DiskIndexHeader::MAGIC) {
-            CloseHandle(hFile);
-            return false;
+        using HeapItem = std::pair<uint32_t, uint32_t>;  // trigram, shard
+        std::vector<HeapItem> heap;
+        std::vector<size_t> cursor(shardCount, 0);
+        for (uint32_t s = 0; s < shardCount; ++s) {
+            if (!shards[s].trigrams.empty()) {
+                heap.emplace_back(shards[s].trigrams[0].trigram, s);
+            }
         }
+        std::make_heap(heap.begin(), heap.end(), std::greater<>());
+
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+            uint32_t s = heap.back().second;
+            heap.pop_back();
+
+            const auto& src = shards[s].trigrams[cursor[s]];
+            DiskTrigramEntry te = src;
+            te.firstBlock = static_cast<uint32_t>(layout.blocks.size());
+            layout.trigrams.push_back(te);
+
+            uint32_t blockCount = PostingCodec::blockCountFor(src.postingCount);
+            for (uint32_t b = 0; b < blockCount; ++b) {
+                DiskPostingBlock block = shards[s].blocks[src.firstBlock + b];
+                block.dataOffset += wordBase[s];
+                layout.blocks.push_back(block);
+            }
 
-        entries_.resize(header.entryCount);
-        ReadFile(hFile, entries_.data(), header.entryCount * sizeof(DiskFileEntry), &read, nullptr);
+            if (++cursor[s] < shards[s].trigrams.size()) {
+                heap.emplace_back(shards[s].trigrams[cursor[s]].trigram, s);
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+            }
+        }
 
-        stringPool_.resize(header.stringPoolSize);
-        ReadFile(hFile, stringPool_.data(), header.stringPoolSize * sizeof(wchar_t), &read, nullptr);
+        return layout;
+    }
 
-        LARGE_INTEGER skip;
-        skip.QuadPart = header.trigramCount * sizeof(DiskTrigramEntry) +
-                        header.postingDataSize * sizeof(uint32_t);
-        SetFilePointerEx(hFile, skip, nullptr, FILE_CURRENT);
+    // Resolves every parentRef to an entry index once, at build time, so
+    // readers can walk paths as array lookups.
+    std::vector<uint32_t> resolveParents() const {
+        std::vector<uint32_t> parentIndex(entries_.size(), DiskIndex::NO_PARENT);
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            const auto& e = entries_[i];
+            if (e.fileRef == 0) continue;
 
-        uint32_t metaCount = 0;
-        ReadFile(hFile, &metaCount, sizeof(metaCount), &read, nullptr);
-        driveMetadata_.resize(metaCount);
-        ReadFile(hFile, driveMetadata_.data(), metaCount * sizeof(DriveMetadata), &read, nullptr);
+            auto it = refToIndex_.find(makeRefKey(e.driveIndex, e.parentRef));
+            if (it != refToIndex_.end() && it->second != i) {
+                parentIndex[i] = it->second;
+            }
+        }
+        return parentIndex;
+    }
 
-        CloseHandle(hFile);
+    // Puts the entries in depth-first pre-order, so every subtree is the
+    // contiguous range [idx, subtreeEnd_[idx]) and a directory-scoped search
+    // can restrict postings with a range check. Entries caught in a parent
+    // cycle are treated as roots.
+    void orderByTree() {
+        const uint32_t count = static_cast<uint32_t>(entries_.size());
 
-        refToIndex_.clear();
-        refToIndex_.reserve(entries_.size());
-        for (uint32_t i = 0; i < entries_.size(); ++i) {
-            if (entries_[i].fileRef != 0) {
-                uint64_t key = makeRefKey(entries_[i].driveIndex, entries_[i].fileRef);
-                refToIndex_[key] = i;
-            }
+        std::vector<uint32_t> childStart(count + 1, 0);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (parentIndex_[i] != DiskIndex::NO_PARENT) childStart[parentIndex_[i] + 1]++;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            childStart[i + 1] += childStart[i];
         }
+        std::vector<uint32_t> children(childStart[count]);
+        std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (parentIndex_[i] != DiskIndex::NO_PARENT) children[fill[parentIndex_[i]]++] = i;
+        }
+        std::vector<uint32_t>().swap(fill);
+
+        std::vector<uint32_t> order;       // new position -> old index
+        std::vector<uint32_t> newIndex(count, DiskIndex::NOT_FOUND);
+        std::vector<uint32_t> subtreeEnd(count);
+        order.reserve(count);
+
+        struct Frame {
+            uint32_t node;
+            uint32_t nextChild;
+        };
+        std::vector<Frame> stack;
+
+        auto visit = [&](uint32_t root) {
+            newIndex[root] = static_cast<uint32_t>(order.size());
+            order.push_back(root);
+            stack.push_back({ root, childStart[root] });
+
+            while (!stack.empty()) {
+                Frame& f = stack.back();
+                if (f.nextChild == childStart[f.node + 1]) {
+                    subtreeEnd[newIndex[f.node]] = static_cast<uint32_t>(order.size());
+                    stack.pop_back();
+                    continue;
+                }
 
-        trigramPostings_.clear();
-        shortNames_.clear();
-        for (uint32_t i = 0; i < entries_.size(); ++i) {
-            if (entries_[i].fileRef != 0) {
-                addTrigrams(i, getName(i));
+                uint32_t child = children[f.nextChild++];
+                if (newIndex[child] != DiskIndex::NOT_FOUND) continue;
+                newIndex[child] = static_cast<uint32_t>(order.size());
+                order.push_back(child);
+                stack.push_back({ child, childStart[child] });
             }
+        };
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (parentIndex_[i] == DiskIndex::NO_PARENT) visit(i);
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            if (newIndex[i] == DiskIndex::NOT_FOUND) visit(i);
         }
 
-        return true;
-    }
+        std::vector<DiskFileEntry> entries(count);
+        std::vector<uint64_t> sizes(count);
+        std::vector<uint32_t> modifiedTimes(count);
+        std::vector<uint32_t> parentIndex(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            entries[i] = entries_[order[i]];
+            sizes[i] = sizes_[order[i]];
+            modifiedTimes[i] = modifiedTimes_[order[i]];
+            uint32_t parent = parentIndex_[order[i]];
+            parentIndex[i] = parent == DiskIndex::NO_PARENT ? parent : newIndex[parent];
+        }
+        for (auto& [key, idx] : refToIndex_) {
+            idx = newIndex[idx];
+        }
 
-    uint32_t getVolumeSerial(wchar_t drive) {
-        wchar_t root[4] = { drive, L':', L'\\', 0 };
-        DWORD serial = 0;
-        GetVolumeInformationW(root, nullptr, 0, &serial, nullptr, nullptr, nullptr, 0);
-        return serial;
+        entries_ = std::move(entries);
+        sizes_ = std::move(sizes);
+        modifiedTimes_ = std::move(modifiedTimes);
+        parentIndex_ = std::move(parentIndex);
+        subtreeEnd_ = std::move(subtreeEnd);
     }
 
-    void captureJournalPosition(wchar_t drive, DriveMetadata& meta) {
-        wchar_t volumePath[8] = { L'\\', L'\\', L'.', L'\\', drive, L':', 0 };
+    // Folds every name once, in parallel; trigrams and the folded pool in the
+    // file both come from this copy.
+    void foldStringPool() {
+        // keep every section after the string pools 4-byte aligned
+        if (stringPool_.size() & 1) {
+            stringPool_.push_back(L'\0');
+        }
 
-        HANDLE hVolume = CreateFileW(volumePath, GENERIC_READ,
-                                     FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                     nullptr, OPEN_EXISTING, 0, nullptr);
-        if (hVolume == INVALID_HANDLE_VALUE) return;
+        foldedPool_.resize(stringPool_.size());
+        constexpr size_t CHUNK = 1024 * 1024;
+        size_t chunks = (stringPool_.size() + CHUNK - 1) / CHUNK;
+        parallelFor(chunks, workerCount(), [&](size_t c) {
+            size_t begin = c * CHUNK;
+            size_t count = std::min(CHUNK, stringPool_.size() - begin);
+            CaseFold::foldInto(stringPool_.data() + begin, count, foldedPool_.data() + begin);
+        });
+    }
 
-        USN_JOURNAL_DATA_V0 journalData{};
-        DWORD bytesReturned;
+    // Builds the posting lists and writes the index; false if cancelled or
+    // the file couldn't be written.
+    bool writeIndex(const std::wstring& path, std::atomic<bool>& cancel, BuildStats& stats,
+                    const ProgressCallback& progress, const wchar_t* writeStatus) {
+        orderByTree();
+        foldStringPool();
 
-        if (DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL,
-                            nullptr, 0, &journalData, sizeof(journalData),
-                            &bytesReturned, nullptr)) {
-            meta.lastUsn = journalData.NextUsn;
-            meta.journalId = journalData.UsnJournalID;
+        if (memoryBudget_ > 0) {
+            return writeIndexStreaming(path, cancel, stats, progress, writeStatus);
         }
 
-        CloseHandle(hVolume);
-    }
+        PostingLayout postings = buildPostings(cancel);
+        if (cancel) return false;
+        stats.trigramsCreated = static_cast<uint32_t>(postings.trigrams.size());
 
-    void queryJournalChanges(DriveMetadata& meta, std::vector<uint64_t>& deleted,
-                             std::vector<FileChange>& added, std::atomic<bool>& cancel,
-                             uint8_t driveIndex) {
-        wchar_t volumePath[8] = { L'\\', L'\\', L'.', L'\\', meta.driveLetter, L':', 0 };
+        if (progress) progress(0.90f, writeStatus);
 
-        HANDLE hVolume = CreateFileW(volumePath, GENERIC_READ,
-                                     FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                     nullptr, OPEN_EXISTING, 0, nullptr);
-        if (hVolume == INVALID_HANDLE_VALUE) return;
+        return writeToFile(path, postings);
+    }
 
-        // verify journal ID hasn't changed
-        USN_JOURNAL_DATA_V0 journalData{};
-        DWORD bytesReturned;
+    // Streams one sorted run of (trigram << 32 | index) pairs back from disk.
+    // Runs are mapped and read front to back once, so the pager can read
+    // ahead and drop pages behind the merge.
+    class RunReader {
+    public:
+        explicit RunReader(const std::wstring& path) {
+            if (file_.open(path, MappedFile::Access::Sequential)) {
+                count_ = file_.size() / sizeof(uint64_t);
+            }
+        }
+
+        bool done() const { return pos_ >= count_; }
 
-        if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL,
-                             nullptr, 0, &journalData, sizeof(journalData),
-                             &bytesReturned, nullptr)) {
-            CloseHandle(hVolume);
-            return;
+        uint64_t current() const {
+            uint64_t value;
+            memcpy(&value, file_.data() + pos_ * sizeof(uint64_t), sizeof(value));
+            return value;
         }
 
-        if (journalData.UsnJournalID != meta.journalId) {
-            // journal was recreated, can't do incremental - signal by adding many fake changes (idk theres prob a better way to do that)
-            CloseHandle(hVolume);
-            for (uint32_t i = 0; i < 1000000; ++i) {
-                deleted.push_back(makeRefKey(driveIndex, i));
+        void next() { ++pos_; }
+
+    private:
+        MappedFile file_;
+        size_t pos_ = 0;
+        size_t count_ = 0;
+    };
+
+    // External-sort build: peak memory is the entry table plus the budget,
+    // regardless of how many postings the index ends up with.
+    bool writeIndexStreaming(const std::wstring& path, std::atomic<bool>& cancel, BuildStats& stats,
+                             const ProgressCallback& progress, const wchar_t* writeStatus) {
+        constexpr size_t MIN_RUN_BYTES = 16 * 1024 * 1024;
+        constexpr size_t WORD_FLUSH_WORDS = 1024 * 1024;
+
+        size_t fixedBytes = entries_.size() * (sizeof(DiskFileEntry) + sizeof(uint64_t) + sizeof(uint32_t)) +
+                            parentIndex_.size() * sizeof(uint32_t) * 2 +
+                            stringPool_.size() * sizeof(wchar_t) * 2;
+        size_t runBytes = memoryBudget_ > fixedBytes + MIN_RUN_BYTES
+                              ? memoryBudget_ - fixedBytes
+                              : MIN_RUN_BYTES;
+        size_t runCapacity = runBytes / sizeof(uint64_t);
+
+        std::vector<std::wstring> runPaths;
+        auto cleanup = [&]() {
+            for (const auto& run : runPaths) FileWriter::remove(run);
+        };
+
+        std::vector<uint64_t> run;
+        run.reserve(runCapacity);
+
+        auto flushRun = [&]() {
+            // a name can repeat a trigram; the codec needs strictly increasing ids
+            std::sort(run.begin(), run.end());
+            run.erase(std::unique(run.begin(), run.end()), run.end());
+
+            std::wstring runPath = path + L".run" + std::to_wstring(runPaths.size()) + L".tmp";
+            FileWriter out;
+            if (!out.create(runPath, true)) return false;
+
+            runPaths.push_back(runPath);
+            out.write(run.data(), run.size() * sizeof(uint64_t));
+            run.clear();
+            return out.close();
+        };
+
+        for (uint32_t idx = 0; idx < entries_.size(); ++idx) {
+            if (cancel) {
+                cleanup();
+                return false;
+            }
+            if (entries_[idx].fileRef == 0) continue;  // deleted entry
+
+            forEachKey(getFoldedName(idx), [&](uint32_t key) {
+                run.push_back((static_cast<uint64_t>(key) << 32) | idx);
+            });
+
+            if (run.size() >= runCapacity && !flushRun()) {
+                cleanup();
+                return false;
             }
-            return;
         }
 
-        READ_USN_JOURNAL_DATA_V0 readData{};
-        readData.StartUsn = meta.lastUsn;
-        readData.ReasonMask = USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE |
-                              USN_REASON_RENAME_NEW_NAME | USN_REASON_RENAME_OLD_NAME;
-        readData.ReturnOnlyOnClose = FALSE;
-        readData.Timeout = 0;
-        readData.BytesToWaitFor = 0;
-        readData.UsnJournalID = meta.journalId;
+        if (!run.empty() && !flushRun()) {
+            cleanup();
+            return false;
+        }
+        std::vector<uint64_t>().swap(run);
+
+        if (progress) progress(0.90f, writeStatus);
+
+        // Merge the runs. Directory and block table stay in memory (a few
+        // bytes per 128 postings); packed words go to a spill file that is
+        // appended to the index once the directory is known.
+        std::vector<std::unique_ptr<RunReader>> readers;
+        readers.reserve(runPaths.size());
+        for (const auto& runPath : runPaths) {
+            readers.push_back(std::make_unique<RunReader>(runPath));
+        }
+
+        std::wstring wordsPath = path + L".words.tmp";
+        FileWriter words;
+        if (!words.create(wordsPath, true)) {
+            readers.clear();
+            cleanup();
+            return false;
+        }
+
+        PostingLayout layout;
+        std::vector<uint32_t> pending;
+        pending.reserve(PostingCodec::BLOCK_SIZE);
+        uint32_t wordsFlushed = 0;
+        bool ok = true;
+
+        auto encodePending = [&]() {
+            size_t firstNew = layout.blocks.size();
+            PostingCodec::encode(pending, layout.blocks, layout.words);
+            for (size_t b = firstNew; b < layout.blocks.size(); ++b) {
+                layout.blocks[b].dataOffset += wordsFlushed;
+            }
+            pending.clear();
+
+            if (layout.words.size() >= WORD_FLUSH_WORDS) {
+                words.write(layout.words.data(), layout.words.size() * sizeof(uint32_t));
+                wordsFlushed += static_cast<uint32_t>(layout.words.size());
+                layout.words.clear();
+            }
+        };
 
-        std::vector<uint8_t> buffer(64 * 1024);
+        using HeapItem = std::pair<uint64_t, size_t>;  // pair value, run
+        std::vector<HeapItem> heap;
+        for (size_t r = 0; r < readers.size(); ++r) {
+            if (!readers[r]->done()) heap.emplace_back(readers[r]->current(), r);
+        }
+        std::make_heap(heap.begin(), heap.end(), std::greater<>());
 
-        while (!cancel) {
-            if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL,
-                                 &readData, sizeof(readData),
-                                 buffer.data(), static_cast<DWORD>(buffer.size()),
-                                 &bytesReturned, nullptr)) {
+        uint64_t last = UINT64_MAX;
+        while (!heap.empty() && ok) {
+            if (cancel) {
+                ok = false;
                 break;
             }
 
-            if (bytesReturned <= sizeof(USN)) break;
+            std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+            auto [value, r] = heap.back();
+            heap.pop_back();
 
-            USN nextUsn = *reinterpret_cast<USN*>(buffer.data());
-            auto* record = reinterpret_cast<USN_RECORD*>(buffer.data() + sizeof(USN));
-            DWORD remaining = bytesReturned - sizeof(USN);
+            readers[r]->next();
+            if (!readers[r]->done()) {
+                heap.emplace_back(readers[r]->current(), r);
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+            }
 
-            while (remaining > 0 && !cancel) {
-                if (record->RecordLength == 0) break;
+            // the same pair can land in two runs when a flush splits a name
+            if (value == last) continue;
 
-                if (record->Reason & (USN_REASON_FILE_DELETE | USN_REASON_RENAME_OLD_NAME)) {
-                    deleted.push_back(makeRefKey(driveIndex, record->FileReferenceNumber));
-                }
-                if (record->Reason & (USN_REASON_FILE_CREATE | USN_REASON_RENAME_NEW_NAME)) {
-                    std::wstring name(record->FileName, record->FileNameLength / sizeof(wchar_t));
-                    added.push_back({
-                        meta.driveLetter,
-                        record->FileReferenceNumber,
-                        record->ParentFileReferenceNumber,
-                        std::move(name),
-                        record->FileAttributes
-                    });
-                }
+            uint32_t tri = static_cast<uint32_t>(value >> 32);
+            if (layout.trigrams.empty() || layout.trigrams.back().trigram != tri) {
+                if (!pending.empty()) encodePending();
 
-                remaining -= record->RecordLength;
-                record = reinterpret_cast<USN_RECORD*>(
-                    reinterpret_cast<uint8_t*>(record) + record->RecordLength);
+                DiskTrigramEntry te{};
+                te.trigram = tri;
+                te.firstBlock = static_cast<uint32_t>(layout.blocks.size());
+                layout.trigrams.push_back(te);
             }
+            last = value;
+
+            layout.trigrams.back().postingCount++;
+            pending.push_back(static_cast<uint32_t>(value));
+            if (pending.size() == PostingCodec::BLOCK_SIZE) encodePending();
+        }
+
+        if (ok && !pending.empty()) encodePending();
+        if (ok && !layout.words.empty()) {
+            words.write(layout.words.data(), layout.words.size() * sizeof(uint32_t));
+            wordsFlushed += static_cast<uint32_t>(layout.words.size());
+            layout.words.clear();
+        }
+
+        ok = words.close() && ok;
+        readers.clear();
+        cleanup();
+
+        if (ok) {
+            stats.trigramsCreated = static_cast<uint32_t>(layout.trigrams.size());
+            ok = writeToFile(path, layout, wordsPath, wordsFlushed);
+        }
+        FileWriter::remove(wordsPath);
+        return ok;
+    }
+
+    // Packed words come from postings.words, or for streamed builds from
+    // a spill file holding spilledWordCount words. False, with any previous
+    // index and its delta left as they were, if the file couldn't be written.
+    bool writeToFile(const std::wstring& path, const PostingLayout& postings,
+                     const std::wstring& wordsSpillPath = {}, uint32_t spilledWordCount = 0) {
+        DiskIndexHeader header{};
+        header.magic = DiskIndexHeader::MAGIC;
+        header.version = DiskIndexHeader::VERSION;
+        header.entryCount = static_cast<uint32_t>(entries_.size());
+        header.stringPoolSize = static_cast<uint32_t>(stringPool_.size());
+        header.trigramCount = static_cast<uint32_t>(postings.trigrams.size());
+        header.postingDataSize = wordsSpillPath.empty()
+                                     ? static_cast<uint32_t>(postings.words.size())
+                                     : spilledWordCount;
+        header.postingBlockCount = static_cast<uint32_t>(postings.blocks.size());
+        header.buildTimestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+
+        ExtensionTable extensions = buildExtensionTable();
+        header.extensionCount = static_cast<uint32_t>(extensions.offsets.size() - 1);
+        header.extensionPoolSize = static_cast<uint32_t>(extensions.pool.size());
+        if (extensions.pool.size() & 1) extensions.pool.push_back(0);
+        if (extensions.ids.size() & 1) extensions.ids.push_back(0);
+
+        std::wstring tempPath = path + L".tmp";
+
+        FileWriter out;
+        if (!out.create(tempPath)) return false;
+
+        out.write(&header, sizeof(header));
+        out.write(entries_.data(), entries_.size() * sizeof(DiskFileEntry));
+        out.write(sizes_.data(), sizes_.size() * sizeof(uint64_t));
+        out.write(parentIndex_.data(), parentIndex_.size() * sizeof(uint32_t));
+        out.write(subtreeEnd_.data(), subtreeEnd_.size() * sizeof(uint32_t));
+        auto refOrder = buildRefOrder();
+        out.write(refOrder.data(), refOrder.size() * sizeof(uint32_t));
+        out.write(modifiedTimes_.data(), modifiedTimes_.size() * sizeof(uint32_t));
+        out.write(extensions.ids.data(), extensions.ids.size() * sizeof(uint16_t));
+        out.writeChars(stringPool_.data(), stringPool_.size());
+        out.writeChars(foldedPool_.data(), foldedPool_.size());
+        out.write(extensions.offsets.data(), extensions.offsets.size() * sizeof(uint32_t));
+        out.write(extensions.pool.data(), extensions.pool.size() * sizeof(DiskChar));
+        out.write(postings.trigrams.data(), postings.trigrams.size() * sizeof(DiskTrigramEntry));
+        out.write(postings.blocks.data(), postings.blocks.size() * sizeof(DiskPostingBlock));
+        if (wordsSpillPath.empty()) {
+            out.write(postings.words.data(), postings.words.size() * sizeof(uint32_t));
+        } else if (spilledWordCount > 0) {
+            MappedFile spill;
+            if (!spill.open(wordsSpillPath, MappedFile::Access::Sequential)) {
+                out.close();
+                FileWriter::remove(tempPath);
+                return false;
+            }
+            out.write(spill.data(), spill.size());
+        }
+
+        uint32_t metaCount = static_cast<uint32_t>(driveMetadata_.size());
+        out.write(&metaCount, sizeof(metaCount));
+        out.write(driveMetadata_.data(), driveMetadata_.size() * sizeof(DriveMetadata));
 
-            readData.StartUsn = nextUsn;
-            if (nextUsn >= journalData.NextUsn) break;
+        // keep the previous index rather than replace it with a short file
+        if (!out.close() || !FileWriter::replace(tempPath, path)) {
+            FileWriter::remove(tempPath);
+            return false;
         }
 
-        meta.lastUsn = journalData.NextUsn;
-        CloseHandle(hVolume);
+        // a fresh base supersedes any delta written against the old one
+        FileWriter::remove(DeltaSegment::pathFor(path));
+        return true;
+    }
+
+    struct ExtensionTable {
+        std::vector<uint16_t> ids;      // per entry
+        std::vector<uint32_t> offsets;  // per extension, plus one past the last
+        std::vector<DiskChar> pool;     // folded extensions, sorted
+    };
+
+    // Interns every entry's folded extension. Ids follow the sorted table,
+    // so "" is NO_EXTENSION; past the id space the rarest extensions share
+    // OTHER_EXTENSION.
+    ExtensionTable buildExtensionTable() const {
+        constexpr size_t MAX_IDS = FileMetadata::OTHER_EXTENSION;
+
+        std::unordered_map<std::wstring_view, uint32_t> counts;
+        counts[{}] = 0;
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            counts[DiskIndex::extensionOf(getFoldedName(i))]++;
+        }
+
+        std::vector<std::pair<std::wstring_view, uint32_t>> kept(counts.begin(), counts.end());
+        if (kept.size() > MAX_IDS) {
+            std::nth_element(kept.begin(), kept.begin() + MAX_IDS, kept.end(), [](const auto& a, const auto& b) {
+                if (a.first.empty() != b.first.empty()) return a.first.empty();
+                return a.second > b.second;
+            });
+            kept.resize(MAX_IDS);
+        }
+        std::sort(kept.begin(), kept.end());
+
+        ExtensionTable table;
+        std::unordered_map<std::wstring_view, uint16_t> ids;
+        for (const auto& [ext, count] : kept) {
+            ids[ext] = static_cast<uint16_t>(table.offsets.size());
+            table.offsets.push_back(static_cast<uint32_t>(table.pool.size()));
+            table.pool.insert(table.pool.end(), ext.begin(), ext.end());
+        }
+        table.offsets.push_back(static_cast<uint32_t>(table.pool.size()));
+
+        table.ids.resize(entries_.size());
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            auto it = ids.find(DiskIndex::extensionOf(getFoldedName(i)));
+            table.ids[i] = it != ids.end() ? it->second : FileMetadata::OTHER_EXTENSION;
+        }
+        return table;
+    }
+
+    // Entry indices ordered by (drive, fileRef), so an update can find the
+    // entry for a journal record with a binary search of the mapped file.
+    std::vector<uint32_t> buildRefOrder() const {
+        std::vector<std::pair<uint64_t, uint32_t>> keyed(entries_.size());
+        for (uint32_t i = 0; i < entries_.size(); ++i) {
+            keyed[i] = { makeRefKey(entries_[i].driveIndex, entries_[i].fileRef), i };
+        }
+        std::sort(keyed.begin(), keyed.end());
+
+        std::vector<uint32_t> order(keyed.size());
+        for (size_t i = 0; i < keyed.size(); ++i) {
+            order[i] = keyed[i].second;
+        }
+        return order;
+    }
+
+#ifdef _WIN32
+    uint32_t getVolumeSerial(wchar_t drive) {
+        wchar_t root[4] = { drive, L':', L'\\', 0 };
+        DWORD serial = 0;
+        GetVolumeInformationW(root, nullptr, 0, &serial, nullptr, nullptr, nullptr, 0);
+        return serial;
     }
+#endif
 
     std::vector<DiskFileEntry> entries_;
+    std::vector<uint64_t> sizes_;
+    std::vector<uint32_t> modifiedTimes_;
     std::vector<wchar_t> stringPool_;
-    std::unordered_map<uint32_t, std::vector<uint32_t>> trigramPostings_;
-    std::vector<uint32_t> shortNames_;
+    std::vector<wchar_t> foldedPool_;
+    std::vector<uint32_t> parentIndex_;
+    std::vector<uint32_t> subtreeEnd_;
     std::unordered_map<uint64_t, uint32_t> refToIndex_;
     std::vector<DriveMetadata> driveMetadata_;
+    size_t memoryBudget_ = 0;
 };
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Every struct below is packed and every field little-endian, so an index
+// reads the same on any platform and compiler. Names are stored as UTF-16
+// code units (DiskChar); where wchar_t is wider they are converted on load
+// and write.
+using DiskChar = uint16_t;
+
+// On-disk layout of search.idx, in file order:
+//   DiskIndexHeader
+//   DiskFileEntry[entryCount]          in depth-first pre-order
+//   uint64_t fileSize[entryCount]      FileMetadata::UNKNOWN_SIZE for directories
+//   uint32_t parentIndex[entryCount]   resolved parent entry, or NO_PARENT
+//   uint32_t subtreeEnd[entryCount]    one past the entry's last descendant
+//   uint32_t refOrder[entryCount]      entry indices sorted by (drive, fileRef)
+//   uint32_t modifiedTime[entryCount]  seconds since the Unix epoch
+//   uint16_t extensionId[entryCount]   padded to an even count
+//   DiskChar stringPool[stringPoolSize] padded to an even count
+//   DiskChar foldedPool[stringPoolSize] case-folded copy, same offsets
+//   uint32_t extensionOffsets[extensionCount + 1] into the extension pool
+//   DiskChar extensionPool[extensionPoolSize] folded extensions, sorted,
+//                                      padded to an even count
+//   DiskTrigramEntry[trigramCount]    sorted by key: trigrams, bigrams,
+//                                      then first-char buckets
+//   DiskPostingBlock[postingBlockCount]
+//   uint32_t postingData[postingDataSize]
+//   uint32_t metaCount, DriveMetadata[metaCount]
+
+#pragma pack(push, 1)
+struct DiskIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t stringPoolSize;
+    uint32_t trigramCount;
+    uint32_t postingDataSize;   // packed posting words
+    uint64_t buildTimestamp;
+    uint32_t postingBlockCount;
+    uint32_t extensionCount;
+    uint32_t extensionPoolSize;
+    uint32_t reserved;
+
+    static constexpr uint32_t MAGIC = 0x56454C49;  // "VELI"
+    static constexpr uint32_t VERSION = 9;  // v9: size, time and extension columns
+};
+
+struct DiskFileEntry {
+    uint64_t fileRef;
+    uint64_t parentRef;
+    uint32_t nameOffset;
+    uint16_t nameLength;
+    uint8_t attributes;
+    uint8_t driveIndex;
+};
+
+struct DiskTrigramEntry {
+    uint32_t trigram;
+    uint32_t firstBlock;
+    uint32_t postingCount;
+};
+
+// Values of the metadata columns. Extension ids index the sorted extension
+// table; id 0 is the empty extension, and should a volume hold more distinct
+// extensions than ids, the rarest share OTHER_EXTENSION.
+struct FileMetadata {
+    static constexpr uint64_t UNKNOWN_SIZE = UINT64_MAX;
+    static constexpr uint32_t UNKNOWN_TIME = 0;
+    static constexpr uint16_t NO_EXTENSION = 0;
+    static constexpr uint16_t OTHER_EXTENSION = UINT16_MAX;
+    static constexpr size_t MAX_EXTENSION_LENGTH = 16;  // longer suffixes aren't extensions
+
+    // NTFS timestamps count 100ns ticks since 1601
+    static uint32_t fromFileTime(uint64_t fileTime) {
+        constexpr uint64_t TICKS_PER_SECOND = 10000000;
+        constexpr uint64_t EPOCH_DIFFERENCE = 11644473600;  // 1601 to 1970, in seconds
+        uint64_t seconds = fileTime / TICKS_PER_SECOND;
+        if (seconds <= EPOCH_DIFFERENCE) return UNKNOWN_TIME;
+        return static_cast<uint32_t>(std::min<uint64_t>(seconds - EPOCH_DIFFERENCE, UINT32_MAX));
+    }
+};
+
+// Bits of DiskFileEntry::attributes: the low byte of the Win32
+// FILE_ATTRIBUTE_* values, so entries mean the same on every platform.
+struct FileAttributes {
+    static constexpr uint8_t HIDDEN = 0x02;
+    static constexpr uint8_t DIRECTORY = 0x10;
+};
+
+struct DriveMetadata {
+    DiskChar driveLetter;
+    uint8_t padding[2];
+    uint32_t volumeSerial;
+    uint64_t lastUsn;
+    uint64_t journalId;
+};
+
+// search.idx.delta, in file order:
+//   DeltaSegmentHeader
+//   DiskFileEntry[addedCount]          nameOffset into the delta's own pool
+//   uint32_t parents[addedCount]       index in the combined base + delta space
+//   uint64_t fileSize[addedCount]
+//   uint32_t modifiedTime[addedCount]
+//   DiskChar stringPool[stringPoolSize]
+//   uint32_t tombstones[tombstoneCount] sorted, base or delta indices
+//   DriveMetadata[metaCount]           journal positions the delta is current to
+struct DeltaSegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t baseTimestamp;     // buildTimestamp of the index it patches
+    uint32_t baseEntryCount;
+    uint32_t addedCount;
+    uint32_t stringPoolSize;
+    uint32_t tombstoneCount;
+    uint32_t metaCount;
+    uint32_t reserved[3];
+
+    static constexpr uint32_t MAGIC = 0x56454C44;  // "VELD"
+    static constexpr uint32_t VERSION = 2;
+};
+
+// search.idx.frecency, in file order:
+//   FrecencyHeader
+//   FrecencyRecord[recordCount]        sorted by refKey
+struct FrecencyHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t reserved;
+
+    static constexpr uint32_t MAGIC = 0x56454C46;  // "VELF"
+    static constexpr uint32_t VERSION = 1;
+};
+
+struct FrecencyRecord {
+    uint64_t refKey;            // DiskIndex::makeRefKey, stable across rebuilds
+    uint64_t lastUsed;          // seconds since the Unix epoch
+    float score;                // decayed use count as of lastUsed
+    uint32_t useCount;
+};
+#pragma pack(pop)
+
+static_assert(std::endian::native == std::endian::little, "index files are little-endian");
+static_assert(sizeof(DiskIndexHeader) == 48, "DiskIndexHeader size mismatch");
+static_assert(sizeof(DiskFileEntry) == 24, "DiskFileEntry size mismatch");
+static_assert(sizeof(DiskTrigramEntry) == 12, "DiskTrigramEntry size mismatch");
+static_assert(sizeof(DriveMetadata) == 24, "DriveMetadata size mismatch");
+static_assert(sizeof(DeltaSegmentHeader) == 48, "DeltaSegmentHeader size mismatch");
+static_assert(sizeof(FrecencyHeader) == 16, "FrecencyHeader size mismatch");
+static_assert(sizeof(FrecencyRecord) == 24, "FrecencyRecord size mismatch");
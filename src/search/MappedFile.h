@@ -0,0 +1,291 @@
+#pragma once
+
+#ifdef _WIN32
+#include "../../framework.h"
+#else
+#include "Utf8.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Read-only mapping of a whole file. The access pattern is a hint to the
+// pager: readahead for files read front to back, none for files probed at
+// random. advise() narrows it for part of the file, e.g. the posting
+// sections of an index whose entry table is scanned sequentially.
+//
+// On Windows, Share::Read fails for a file open for writing and keeps it
+// from being written while mapped, as index files want. Files searched by
+// content may be open in an editor; Share::All maps them anyway. POSIX has
+// no share modes and maps either way.
+class MappedFile {
+public:
+    enum class Access { Normal, Sequential, Random };
+    enum class Share { Read, All };
+
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { swap(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // false if the file is missing, empty or can't be mapped
+    bool open(const std::wstring& path, Access access = Access::Normal, Share share = Share::Read) {
+        close();
+
+#ifdef _WIN32
+        DWORD flags = access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+                    : access == Access::Random     ? FILE_FLAG_RANDOM_ACCESS
+                                                   : FILE_ATTRIBUTE_NORMAL;
+        DWORD shareMode = share == Share::All ? FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE
+                                              : FILE_SHARE_READ;
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, shareMode, nullptr,
+                            OPEN_EXISTING, flags, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(view);
+#else
+        (void)share;  // no share modes; a mapping never stops others writing
+        int fd = ::open(nativePath(path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+
+        // the mapping keeps the file alive; the descriptor isn't needed
+        void* view = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) {
+            size_ = 0;
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(view);
+#endif
+
+        advise(0, size_, access);
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    bool isOpen() const { return data_ != nullptr; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Hint for [offset, offset + bytes). Windows only takes the hint for the
+    // whole file, when it is opened.
+    void advise(size_t offset, size_t bytes, Access access) const {
+#ifndef _WIN32
+        if (!data_ || offset >= size_) return;
+
+        // madvise wants a page-aligned start
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset & ~(pageSize - 1);
+        size_t end = std::min(size_, offset + bytes);
+
+        int advice = access == Access::Sequential ? MADV_SEQUENTIAL
+                   : access == Access::Random     ? MADV_RANDOM
+                                                  : MADV_NORMAL;
+        madvise(const_cast<uint8_t*>(data_) + start, end - start, advice);
+#endif
+    }
+
+#ifndef _WIN32
+    // Paths are wide strings everywhere else; POSIX wants UTF-8 bytes.
+    static std::string nativePath(const std::wstring& path) {
+        return Utf8::encode(path);
+    }
+#endif
+
+private:
+    void swap(MappedFile& other) noexcept {
+#ifdef _WIN32
+        std::swap(file_, other.file_);
+        std::swap(mapping_, other.mapping_);
+#endif
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Buffered writer for index files. A failed write sticks, so a sequence of
+// writes can be checked once at close(). writeChars stores wchar_t strings
+// as the 16-bit units the index format uses, whatever the platform's width.
+class FileWriter {
+public:
+    FileWriter() = default;
+    ~FileWriter() { close(); }
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    // temporary files are only read back once, sequentially
+    bool create(const std::wstring& path, bool temporary = false) {
+        close();
+        failed_ = false;
+
+#ifdef _WIN32
+        DWORD flags = temporary ? FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_SEQUENTIAL_SCAN
+                                : FILE_ATTRIBUTE_NORMAL;
+        file_ = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+        return file_ != INVALID_HANDLE_VALUE;
+#else
+        (void)temporary;
+        fd_ = ::open(MappedFile::nativePath(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return fd_ >= 0;
+#endif
+    }
+
+    void write(const void* data, size_t bytes) {
+        if (bytes >= BUFFER_BYTES) {
+            flush();
+            writeRaw(data, bytes);
+            return;
+        }
+        if (buffer_.size() + bytes > BUFFER_BYTES) flush();
+        auto p = static_cast<const uint8_t*>(data);
+        buffer_.insert(buffer_.end(), p, p + bytes);
+    }
+
+    void writeChars(const wchar_t* chars, size_t count) {
+        if constexpr (sizeof(wchar_t) == sizeof(uint16_t)) {
+            write(chars, count * sizeof(wchar_t));
+        } else {
+            uint16_t units[4096];
+            while (count > 0) {
+                size_t n = std::min(count, std::size(units));
+                for (size_t i = 0; i < n; ++i) units[i] = static_cast<uint16_t>(chars[i]);
+                write(units, n * sizeof(uint16_t));
+                chars += n;
+                count -= n;
+            }
+        }
+    }
+
+    // false if any write failed
+    bool close() {
+        flush();
+#ifdef _WIN32
+        bool open = file_ != INVALID_HANDLE_VALUE;
+        if (open) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        bool open = fd_ >= 0;
+        if (open && ::close(fd_) != 0) failed_ = true;
+        fd_ = -1;
+#endif
+        return open && !failed_;
+    }
+
+    // Moves from over to, replacing it.
+    static bool replace(const std::wstring& from, const std::wstring& to) {
+#ifdef _WIN32
+        return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return rename(MappedFile::nativePath(from).c_str(), MappedFile::nativePath(to).c_str()) == 0;
+#endif
+    }
+
+    static void remove(const std::wstring& path) {
+#ifdef _WIN32
+        DeleteFileW(path.c_str());
+#else
+        unlink(MappedFile::nativePath(path).c_str());
+#endif
+    }
+
+private:
+    static constexpr size_t BUFFER_BYTES = 1024 * 1024;
+
+    void flush() {
+        if (buffer_.empty()) return;
+        writeRaw(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+    void writeRaw(const void* data, size_t bytes) {
+        auto ptr = static_cast<const uint8_t*>(data);
+        while (bytes > 0 && !failed_) {
+#ifdef _WIN32
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(bytes, 64 * 1024 * 1024));
+            DWORD written = 0;
+            if (file_ == INVALID_HANDLE_VALUE || !WriteFile(file_, ptr, chunk, &written, nullptr) ||
+                written == 0) {
+                failed_ = true;
+                break;
+            }
+#else
+            ssize_t written = fd_ >= 0 ? ::write(fd_, ptr, bytes) : -1;
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                failed_ = true;
+                break;
+            }
+#endif
+            ptr += written;
+            bytes -= written;
+        }
+    }
+
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+    std::vector<uint8_t> buffer_;
+    bool failed_ = false;
+};
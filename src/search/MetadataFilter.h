@@ -0,0 +1,499 @@
+#pragma once
+
+#include "DiskIndex.h"
+#include <bit>
+#include <ctime>
+#include <string_view>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <immintrin.h>
+#define VELOCITTY_SIMD_SSE2 1
+#endif
+
+// Conditions on the metadata columns, from operator terms of a query:
+//   ext:log,txt       extension is one of these
+//   size:>10mb        also <, >=, <=, = or a bare size; units b, kb, mb, gb, tb
+//   modified:<7d      a date (2024-05-31), today, yesterday, or an age in
+//                     min, h, d or w; ages compare as ages, so this is "in the
+//                     last week", and a bare age means the same as <=. A bare
+//                     date is that whole day
+//   sort:size         rank by size or modified, largest / newest first
+// Terms of the same kind narrow each other. Entries whose size or time is
+// unknown never pass a size: or modified: term.
+//
+// Matching scans the columns a vector at a time (SSE2, or AVX2 where the
+// build targets it), turning each 64 entries into a bitmask of those that
+// pass, or goes over a candidate list when the name query already narrowed
+// it.
+class MetadataFilter {
+public:
+    enum class Sort : uint8_t { Relevance, Size, Modified };
+
+    // Moves every operator term of query into the filter and returns what is
+    // left. Terms that don't parse (e.g. "size:>" while being typed) are
+    // dropped without narrowing anything.
+    std::wstring extract(std::wstring_view query) {
+        std::wstring rest;
+        size_t i = 0;
+        while (i < query.size()) {
+            size_t start = i;
+            while (i < query.size() && query[i] != L' ') ++i;
+            std::wstring_view term = query.substr(start, i - start);
+
+            if (isOperator(term)) {
+                parseTerm(CaseFold::fold(term));
+                while (i < query.size() && query[i] == L' ') ++i;  // drop the gap it leaves
+                continue;
+            }
+
+            rest.append(term);
+            for (; i < query.size() && query[i] == L' '; ++i) rest.push_back(L' ');
+        }
+
+        while (!rest.empty() && rest.back() == L' ') rest.pop_back();
+        return rest;
+    }
+
+    // whether any term narrows the matches (sorting alone doesn't)
+    bool active() const { return !extensions_.empty() || sizeActive_ || timeActive_; }
+
+    Sort sort() const { return sort_; }
+
+    // Identifies the match set for QueryCache: filters with the same key
+    // pass the same entries.
+    std::wstring key() const {
+        if (!active()) return {};
+        std::wstring k = L"ext=";
+        for (const auto& ext : extensions_) {
+            k += ext;
+            k += L',';
+        }
+        if (sizeActive_) k += L";size=" + std::to_wstring(minSize_) + L'-' + std::to_wstring(maxSize_);
+        if (timeActive_) k += L";modified=" + std::to_wstring(minTime_) + L'-' + std::to_wstring(maxTime_);
+        return k;
+    }
+
+    // Looks the extensions up in the index; false if nothing can pass.
+    bool resolve(const DiskIndex& index) {
+        if (sizeActive_ && minSize_ > maxSize_) return false;
+        if (timeActive_ && minTime_ > maxTime_) return false;
+
+        allowed_.assign(size_t(FileMetadata::OTHER_EXTENSION) + 1, extensions_.empty() ? PASS : FAIL);
+        wantedIds_.clear();
+        if (extensions_.empty()) return true;
+
+        // an extension the index ran out of ids for can only be told by name
+        allowed_[FileMetadata::OTHER_EXTENSION] = CHECK_NAME;
+        wantedIds_.push_back(FileMetadata::OTHER_EXTENSION);
+        for (const auto& ext : extensions_) {
+            uint32_t id = index.findExtension(ext);
+            if (id != DiskIndex::NOT_FOUND && id < FileMetadata::OTHER_EXTENSION && allowed_[id] != PASS) {
+                allowed_[id] = PASS;
+                wantedIds_.push_back(static_cast<uint16_t>(id));
+            }
+        }
+        if (wantedIds_.size() > MAX_COMPARED_IDS) wantedIds_.clear();
+        return true;
+    }
+
+    bool matches(const DiskIndex& index, uint32_t idx) const {
+        return inRange(index.fileSize(idx), index.modifiedTime(idx)) && extensionMatches(index, idx);
+    }
+
+    // The entries of [first, last) that pass, in order.
+    void scan(const DiskIndex& index, uint32_t first, uint32_t last, std::vector<uint32_t>& out) const {
+        out.clear();
+        const uint32_t baseEnd = std::min(last, index.baseEntryCount());
+        const uint64_t* sizes = index.fileSizeColumn();
+        const uint32_t* times = index.modifiedTimeColumn();
+        const uint16_t* extIds = index.extensionIdColumn();
+        const uint8_t* allowed = allowed_.data();
+
+        for (uint32_t block = first; block < baseEnd; block += 64) {
+            const uint32_t n = std::min<uint32_t>(64, baseEnd - block);
+
+            // inactive conditions pass everything, so their columns aren't read
+            uint64_t bits = n == 64 ? ~0ULL : (1ULL << n) - 1;
+            if (sizeActive_) bits &= rangeBits(sizes + block, n, minSize_, maxSize_ - minSize_);
+            if (timeActive_) bits &= rangeBits(times + block, n, minTime_, maxTime_ - minTime_);
+            if (!extensions_.empty()) bits &= extensionBits(extIds + block, n);
+
+            while (bits) {
+                uint32_t idx = block + std::countr_zero(bits);
+                bits &= bits - 1;
+                if (allowed[extIds[idx]] == CHECK_NAME && !nameMatches(index, idx)) continue;
+                out.push_back(idx);
+            }
+        }
+
+        for (uint32_t idx = std::max(first, index.baseEntryCount()); idx < last; ++idx) {
+            if (matches(index, idx)) out.push_back(idx);
+        }
+    }
+
+    // The ids in [first, last) of a list that pass.
+    void restrict(const DiskIndex& index, const std::vector<uint32_t>& ids, uint32_t first, uint32_t last,
+                  std::vector<uint32_t>& out) const {
+        out.clear();
+        for (uint32_t pos = first; pos < last; ++pos) {
+            if (ids[pos] < index.entryCount() && matches(index, ids[pos])) out.push_back(ids[pos]);
+        }
+    }
+
+    // Rank for sort:size and sort:modified, monotonic in the column and
+    // within int range; unknown values rank last.
+    int sortScore(const DiskIndex& index, uint32_t idx) const {
+        if (sort_ == Sort::Modified) return static_cast<int>(index.modifiedTime(idx) >> 1);
+
+        // bit length, then the 24 bits below the leading one
+        uint64_t size = index.fileSize(idx);
+        if (size == FileMetadata::UNKNOWN_SIZE) return -1;
+        int width = std::bit_width(size);
+        uint64_t mantissa = width > 25 ? size >> (width - 25) : size << (25 - width);
+        return (width << 24) | static_cast<int>(mantissa & 0xFFFFFF);
+    }
+
+private:
+    enum : uint8_t { FAIL, PASS, CHECK_NAME };
+
+    static constexpr uint32_t SECONDS_PER_DAY = 24 * 60 * 60;
+    // beyond this many wanted extension ids a table lookup per entry is cheaper
+    static constexpr size_t MAX_COMPARED_IDS = 8;
+
+    // Bit j set where v[j] - lo <= span, unsigned: lo <= v[j] <= lo + span.
+    // The vector compares are signed, so both sides get their top bit flipped.
+    static uint64_t rangeBits(const uint64_t* v, uint32_t n, uint64_t lo, uint64_t span) {
+        uint64_t bits = 0;
+        uint32_t j = 0;
+
+#if defined(__AVX2__)
+        const __m256i flip64 = _mm256_set1_epi64x(INT64_MIN);
+        const __m256i lo4 = _mm256_set1_epi64x(static_cast<int64_t>(lo));
+        const __m256i span4 = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(span)), flip64);
+        for (; j + 4 <= n; j += 4) {
+            __m256i d = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + j)), lo4);
+            __m256i over = _mm256_cmpgt_epi64(_mm256_xor_si256(d, flip64), span4);
+            bits |= uint64_t(~_mm256_movemask_pd(_mm256_castsi256_pd(over)) & 0xF) << j;
+        }
+#endif
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        // SSE2 has no 64-bit compare: the high halves decide unless they are
+        // equal, and then the low halves do
+        const __m128i flip32 = _mm_set1_epi32(INT32_MIN);
+        const __m128i lo2 = _mm_set1_epi64x(static_cast<int64_t>(lo));
+        const __m128i span2 = _mm_set1_epi64x(static_cast<int64_t>(span));
+        const __m128i spanFlipped = _mm_xor_si128(span2, flip32);
+        for (; j + 2 <= n; j += 2) {
+            __m128i d = _mm_sub_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + j)), lo2);
+            __m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(d, flip32), spanFlipped);
+            __m128i eq = _mm_cmpeq_epi32(d, span2);
+            __m128i lowGt = _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0));
+            __m128i over = _mm_or_si128(gt, _mm_and_si128(eq, lowGt));  // right in each high half
+            bits |= uint64_t(~_mm_movemask_pd(_mm_castsi128_pd(over)) & 0x3) << j;
+        }
+#endif
+
+        for (; j < n; ++j) {
+            bits |= uint64_t(v[j] - lo <= span) << j;
+        }
+        return bits;
+    }
+
+    static uint64_t rangeBits(const uint32_t* v, uint32_t n, uint32_t lo, uint32_t span) {
+        uint64_t bits = 0;
+        uint32_t j = 0;
+
+#if defined(__AVX2__)
+        const __m256i flip8 = _mm256_set1_epi32(INT32_MIN);
+        const __m256i lo8 = _mm256_set1_epi32(static_cast<int32_t>(lo));
+        const __m256i span8 = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(span)), flip8);
+        for (; j + 8 <= n; j += 8) {
+            __m256i d = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + j)), lo8);
+            __m256i over = _mm256_cmpgt_epi32(_mm256_xor_si256(d, flip8), span8);
+            bits |= uint64_t(~_mm256_movemask_ps(_mm256_castsi256_ps(over)) & 0xFF) << j;
+        }
+#endif
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        const __m128i flip4 = _mm_set1_epi32(INT32_MIN);
+        const __m128i lo4 = _mm_set1_epi32(static_cast<int32_t>(lo));
+        const __m128i span4 = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(span)), flip4);
+        for (; j + 4 <= n; j += 4) {
+            __m128i d = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + j)), lo4);
+            __m128i over = _mm_cmpgt_epi32(_mm_xor_si128(d, flip4), span4);
+            bits |= uint64_t(~_mm_movemask_ps(_mm_castsi128_ps(over)) & 0xF) << j;
+        }
+#endif
+
+        for (; j < n; ++j) {
+            bits |= uint64_t(v[j] - lo <= span) << j;
+        }
+        return bits;
+    }
+
+    // Bit j set where ids[j] isn't FAIL. A few wanted ids are compared
+    // against 8 ids at a time; more go through the allowed_ table.
+    uint64_t extensionBits(const uint16_t* ids, uint32_t n) const {
+        uint64_t bits = 0;
+        uint32_t j = 0;
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        if (!wantedIds_.empty()) {
+            for (; j + 8 <= n; j += 8) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + j));
+                __m128i hit = _mm_setzero_si128();
+                for (uint16_t id : wantedIds_) {
+                    hit = _mm_or_si128(hit, _mm_cmpeq_epi16(v, _mm_set1_epi16(static_cast<short>(id))));
+                }
+                // narrowed to a byte per id, so the byte mask is the id mask
+                bits |= uint64_t(_mm_movemask_epi8(_mm_packs_epi16(hit, _mm_setzero_si128())) & 0xFF) << j;
+            }
+        }
+#endif
+
+        for (; j < n; ++j) {
+            bits |= uint64_t(allowed_[ids[j]] != FAIL) << j;
+        }
+        return bits;
+    }
+
+    static bool isOperator(std::wstring_view term) {
+        for (std::wstring_view name : { L"ext:", L"size:", L"modified:", L"sort:" }) {
+            if (term.size() >= name.size() && CaseFold::fold(term.substr(0, name.size())) == name) return true;
+        }
+        return false;
+    }
+
+    enum class Compare { Equal, Less, LessEqual, Greater, GreaterEqual };
+
+    static Compare takeCompare(std::wstring_view& value) {
+        if (value.starts_with(L">=")) { value.remove_prefix(2); return Compare::GreaterEqual; }
+        if (value.starts_with(L"<=")) { value.remove_prefix(2); return Compare::LessEqual; }
+        if (value.starts_with(L">")) { value.remove_prefix(1); return Compare::Greater; }
+        if (value.starts_with(L"<")) { value.remove_prefix(1); return Compare::Less; }
+        if (value.starts_with(L"=")) value.remove_prefix(1);
+        return Compare::Equal;
+    }
+
+    // as seen from the other side; "= age" is "no older than"
+    static Compare reversed(Compare cmp) {
+        switch (cmp) {
+            case Compare::Less:         return Compare::Greater;
+            case Compare::LessEqual:    return Compare::GreaterEqual;
+            case Compare::Greater:      return Compare::Less;
+            case Compare::GreaterEqual: return Compare::LessEqual;
+            default:                    return Compare::GreaterEqual;
+        }
+    }
+
+    // Narrows [lo, hi] by comparing against the values [first, end).
+    template <typename T>
+    static void narrow(Compare cmp, uint64_t first, uint64_t end, T& lo, T& hi) {
+        uint64_t newLo = lo;
+        uint64_t newHi = hi;
+        switch (cmp) {
+            case Compare::Equal:        newLo = first; newHi = end - 1; break;
+            case Compare::Less:         newHi = first - 1; break;
+            case Compare::LessEqual:    newHi = end - 1; break;
+            case Compare::Greater:      newLo = end; break;
+            case Compare::GreaterEqual: newLo = first; break;
+        }
+        // "<0" leaves nothing; so does anything past the column's range
+        if ((cmp == Compare::Less && first == 0) || newLo > hi) {
+            lo = 1;
+            hi = 0;
+            return;
+        }
+        lo = static_cast<T>(std::max<uint64_t>(lo, newLo));
+        hi = static_cast<T>(std::min<uint64_t>(hi, newHi));
+    }
+
+    void parseTerm(const std::wstring& term) {
+        size_t colon = term.find(L':');
+        std::wstring_view name = std::wstring_view(term).substr(0, colon);
+        std::wstring_view value = std::wstring_view(term).substr(colon + 1);
+
+        if (name == L"ext") {
+            size_t start = 0;
+            for (size_t i = 0; i <= value.size(); ++i) {
+                if (i < value.size() && value[i] != L',' && value[i] != L';') continue;
+                std::wstring_view ext = value.substr(start, i - start);
+                if (!ext.empty() && ext[0] == L'.') ext.remove_prefix(1);
+                if (!ext.empty()) extensions_.emplace_back(ext);
+                start = i + 1;
+            }
+        } else if (name == L"size") {
+            Compare cmp = takeCompare(value);
+            uint64_t size;
+            if (!parseSize(value, size)) return;
+            if (!sizeActive_) {
+                minSize_ = 0;
+                maxSize_ = FileMetadata::UNKNOWN_SIZE - 1;
+                sizeActive_ = true;
+            }
+            narrow(cmp, size, size + 1, minSize_, maxSize_);
+        } else if (name == L"modified") {
+            Compare cmp = takeCompare(value);
+            uint64_t first, end;
+            bool age;
+            if (!parseTime(value, first, end, age)) return;
+            if (!timeActive_) {
+                minTime_ = FileMetadata::UNKNOWN_TIME + 1;
+                maxTime_ = UINT32_MAX;
+                timeActive_ = true;
+            }
+            // an older age is an earlier time
+            if (age) cmp = reversed(cmp);
+            narrow(cmp, first, end, minTime_, maxTime_);
+        } else if (name == L"sort") {
+            if (value == L"size") sort_ = Sort::Size;
+            if (value == L"modified" || value == L"date") sort_ = Sort::Modified;
+        }
+    }
+
+    // a decimal number with an optional binary unit
+    static bool parseSize(std::wstring_view value, uint64_t& size) {
+        double number = 0;
+        double scale = 0;
+        size_t i = 0;
+        bool digits = false;
+        for (; i < value.size(); ++i) {
+            wchar_t c = value[i];
+            if (c >= L'0' && c <= L'9') {
+                digits = true;
+                if (scale == 0) {
+                    number = number * 10 + (c - L'0');
+                } else {
+                    number += (c - L'0') * scale;
+                    scale /= 10;
+                }
+            } else if (c == L'.' && scale == 0) {
+                scale = 0.1;
+            } else {
+                break;
+            }
+        }
+        if (!digits) return false;
+
+        std::wstring_view unit = value.substr(i);
+        static const std::pair<std::wstring_view, double> UNITS[] = {
+            { L"", 1.0 }, { L"b", 1.0 },
+            { L"k", 0x1p10 }, { L"kb", 0x1p10 }, { L"m", 0x1p20 }, { L"mb", 0x1p20 },
+            { L"g", 0x1p30 }, { L"gb", 0x1p30 }, { L"t", 0x1p40 }, { L"tb", 0x1p40 },
+        };
+        for (const auto& [suffix, multiplier] : UNITS) {
+            if (unit != suffix) continue;
+            double bytes = number * multiplier;
+            if (bytes >= 0x1p63) return false;
+            size = static_cast<uint64_t>(bytes);
+            return true;
+        }
+        return false;
+    }
+
+    // The seconds [first, end) a value names: a whole local day for dates,
+    // a single instant for ages.
+    static bool parseTime(std::wstring_view value, uint64_t& first, uint64_t& end, bool& age) {
+        const time_t now = time(nullptr);
+        age = false;
+
+        if (value == L"today" || value == L"yesterday") {
+            std::tm day{};
+#ifdef _WIN32
+            localtime_s(&day, &now);
+#else
+            localtime_r(&now, &day);
+#endif
+            if (value == L"yesterday") day.tm_mday--;
+            return localDay(day.tm_year + 1900, day.tm_mon + 1, day.tm_mday, first, end);
+        }
+
+        int year, month, day;
+        if (value.size() == 10 && value[4] == L'-' && value[7] == L'-' && parseNumber(value.substr(0, 4), year) &&
+            parseNumber(value.substr(5, 2), month) && parseNumber(value.substr(8, 2), day)) {
+            return month >= 1 && month <= 12 && day >= 1 && day <= 31 && localDay(year, month, day, first, end);
+        }
+
+        static const std::pair<std::wstring_view, uint64_t> UNITS[] = {
+            { L"min", 60 }, { L"h", 60 * 60 }, { L"d", SECONDS_PER_DAY }, { L"w", 7 * SECONDS_PER_DAY },
+        };
+        size_t digits = 0;
+        while (digits < value.size() && value[digits] >= L'0' && value[digits] <= L'9') ++digits;
+        int count;
+        if (digits == 0 || digits > 6 || !parseNumber(value.substr(0, digits), count)) return false;
+        for (const auto& [suffix, seconds] : UNITS) {
+            if (value.substr(digits) != suffix) continue;
+            uint64_t ago = count * seconds;
+            first = static_cast<uint64_t>(now) > ago ? static_cast<uint64_t>(now) - ago : 0;
+            end = first + 1;
+            age = true;
+            return true;
+        }
+        return false;
+    }
+
+    static bool localDay(int year, int month, int day, uint64_t& first, uint64_t& end) {
+        std::tm tm{};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day;
+        tm.tm_isdst = -1;
+        time_t start = mktime(&tm);
+        if (start == static_cast<time_t>(-1) || start < 0) return false;
+
+        // days aren't always 24 hours; the next midnight ends this one
+        tm = {};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day + 1;
+        tm.tm_isdst = -1;
+        time_t next = mktime(&tm);
+        first = static_cast<uint64_t>(start);
+        end = next > start ? static_cast<uint64_t>(next) : first + SECONDS_PER_DAY;
+        return true;
+    }
+
+    static bool parseNumber(std::wstring_view digits, int& number) {
+        number = 0;
+        for (wchar_t c : digits) {
+            if (c < L'0' || c > L'9') return false;
+            number = number * 10 + (c - L'0');
+        }
+        return !digits.empty();
+    }
+
+    bool inRange(uint64_t size, uint32_t time) const {
+        return size - minSize_ <= maxSize_ - minSize_ && time - minTime_ <= maxTime_ - minTime_;
+    }
+
+    bool extensionMatches(const DiskIndex& index, uint32_t idx) const {
+        uint8_t allowed = allowed_[index.extensionId(idx)];
+        return allowed == PASS || (allowed == CHECK_NAME && nameMatches(index, idx));
+    }
+
+    bool nameMatches(const DiskIndex& index, uint32_t idx) const {
+        std::wstring_view ext = DiskIndex::extensionOf(index.getFoldedName(idx));
+        for (const auto& wanted : extensions_) {
+            if (ext == wanted) return true;
+        }
+        return false;
+    }
+
+    std::vector<std::wstring> extensions_;  // folded, without the dot
+    std::vector<uint8_t> allowed_;          // FAIL, PASS or CHECK_NAME per extension id
+    std::vector<uint16_t> wantedIds_;       // the ids that aren't FAIL, if few enough to compare
+
+    // inactive ranges span every value, unknowns included
+    bool sizeActive_ = false;
+    uint64_t minSize_ = 0;
+    uint64_t maxSize_ = UINT64_MAX;
+    bool timeActive_ = false;
+    uint32_t minTime_ = 0;
+    uint32_t maxTime_ = UINT32_MAX;
+
+    Sort sort_ = Sort::Relevance;
+};
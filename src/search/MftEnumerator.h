@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../../framework.h"
+#include "CaseFold.h"
+#include "IndexFormat.h"
 #include <functional>
 #include <stack>
 #include <winioctl.h>
@@ -12,13 +14,17 @@
 #define FILE_ATTRIBUTE_RECALL_ON_OPEN 0x00040000
 #endif
 
+// The MFT enumeration doesn't report sizes, and only reports the time of
+// the file's last journal record; the directory walk fallback has both.
 class MftEnumerator {
 public:
     using Callback = std::function<void(
         const std::wstring& name,
         uint64_t fileRef,
         uint64_t parentRef,
-        uint32_t attributes
+        uint32_t attributes,
+        uint64_t size,
+        uint32_t modifiedTime
     )>;
 
     bool enumerateDrive(wchar_t driveLetter, Callback callback, std::atomic<bool>& cancel) {
@@ -128,7 +134,9 @@ private:
                     name,
                     static_cast<uint64_t>(record->FileReferenceNumber),
                     static_cast<uint64_t>(record->ParentFileReferenceNumber),
-                    record->FileAttributes
+                    record->FileAttributes,
+                    FileMetadata::UNKNOWN_SIZE,
+                    FileMetadata::fromFileTime(static_cast<uint64_t>(record->TimeStamp.QuadPart))
                 );
 
                 filesEnumerated++;
@@ -202,7 +210,14 @@ private:
                 uint64_t fileHash = hashPath(fullPath);
                 uint64_t dirParentHash = hashPath(current);
 
-                callback(fd.cFileName, fileHash, dirParentHash, fd.dwFileAttributes);
+                uint64_t size = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                                    ? FileMetadata::UNKNOWN_SIZE
+                                    : (static_cast<uint64_t>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow;
+                uint64_t writeTime = (static_cast<uint64_t>(fd.ftLastWriteTime.dwHighDateTime) << 32) |
+                                     fd.ftLastWriteTime.dwLowDateTime;
+
+                callback(fd.cFileName, fileHash, dirParentHash, fd.dwFileAttributes, size,
+                         FileMetadata::fromFileTime(writeTime));
 
                 if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
                     if (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) continue;
@@ -224,7 +239,7 @@ private:
     static uint64_t hashPath(const std::wstring& path) {
         uint64_t hash = 14695981039346656037ULL;
         for (wchar_t c : path) {
-            hash ^= static_cast<uint64_t>(towlower(c));
+            hash ^= static_cast<uint64_t>(CaseFold::fold(c));
             hash *= 1099511628211ULL;
         }
         return hash;
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "IndexFormat.h"
+#include "Utf8.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+// Walks one mounted filesystem on POSIX systems and reports entries through
+// the same callback as MftEnumerator, with inode numbers as file refs: the
+// parent ref of a top-level entry is the root's inode, which is never itself
+// reported, just as on NTFS. Directories are read in parallel, straight
+// through getdents64 on Linux. Only directories (and entries the file system
+// reports no type for) are stat'ed, to stay on the starting device, unless
+// size and modification time are asked for with setReadMetadata; that costs
+// a stat per file. Callbacks are batched and never run concurrently.
+class PosixEnumerator {
+public:
+    using Callback = std::function<void(
+        const std::wstring& name,
+        uint64_t fileRef,
+        uint64_t parentRef,
+        uint32_t attributes,
+        uint64_t size,
+        uint32_t modifiedTime
+    )>;
+
+    explicit PosixEnumerator(unsigned threads = std::thread::hardware_concurrency())
+        : threads_(std::max(1u, threads)) {}
+
+    // Without it files are reported with UNKNOWN_SIZE and UNKNOWN_TIME.
+    void setReadMetadata(bool read) { readMetadata_ = read; }
+
+    bool enumerate(const std::string& root, Callback callback, std::atomic<bool>& cancel) {
+        struct stat st;
+        if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+
+        device_ = st.st_dev;
+        callback_ = std::move(callback);
+        pending_.clear();
+        pending_.push_back({ root, static_cast<uint64_t>(st.st_ino) });
+        busy_ = 0;
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads_; ++i) {
+            workers.emplace_back([this, &cancel]() { work(cancel); });
+        }
+        work(cancel);
+        for (auto& t : workers) {
+            t.join();
+        }
+        return true;
+    }
+
+private:
+    struct Dir {
+        std::string path;
+        uint64_t ref;
+    };
+
+    struct Record {
+        std::wstring name;
+        uint64_t ref;
+        uint64_t parentRef;
+        uint32_t attributes;
+        uint64_t size;
+        uint32_t modifiedTime;
+    };
+
+    static constexpr size_t BATCH = 4096;
+
+    void work(std::atomic<bool>& cancel) {
+        std::vector<Record> batch;
+        std::vector<Dir> found;
+
+        for (;;) {
+            Dir dir;
+            {
+                std::unique_lock lock(mutex_);
+                cv_.wait(lock, [&]() { return !pending_.empty() || busy_ == 0 || cancel; });
+                if (pending_.empty() || cancel) {
+                    cv_.notify_all();
+                    break;
+                }
+                dir = std::move(pending_.back());
+                pending_.pop_back();
+                ++busy_;
+            }
+
+            readDirectory(dir, batch, found, cancel);
+            if (batch.size() >= BATCH) flush(batch);
+
+            {
+                std::lock_guard lock(mutex_);
+                for (auto& d : found) pending_.push_back(std::move(d));
+                --busy_;
+            }
+            found.clear();
+            cv_.notify_all();
+        }
+
+        flush(batch);
+    }
+
+    void flush(std::vector<Record>& batch) {
+        if (batch.empty()) return;
+        std::lock_guard lock(callbackMutex_);
+        for (const auto& r : batch) {
+            callback_(r.name, r.ref, r.parentRef, r.attributes, r.size, r.modifiedTime);
+        }
+        batch.clear();
+    }
+
+    void readDirectory(const Dir& dir, std::vector<Record>& batch, std::vector<Dir>& found,
+                       std::atomic<bool>& cancel) {
+        int fd = open(dir.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) return;
+
+        auto entry = [&](const char* name, uint64_t ino, unsigned char type) {
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) return;
+
+            bool isDir = type == DT_DIR;
+            uint64_t size = FileMetadata::UNKNOWN_SIZE;
+            uint32_t modifiedTime = FileMetadata::UNKNOWN_TIME;
+            if (readMetadata_ || isDir || type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+                isDir = S_ISDIR(st.st_mode);
+                if (isDir && st.st_dev != device_) return;  // another filesystem mounted here
+
+                if (!isDir) size = static_cast<uint64_t>(st.st_size);
+                if (st.st_mtime > 0) modifiedTime = static_cast<uint32_t>(std::min<int64_t>(st.st_mtime, UINT32_MAX));
+            }
+
+            uint32_t attributes = 0;
+            if (isDir) attributes |= FileAttributes::DIRECTORY;
+            if (name[0] == '.') attributes |= FileAttributes::HIDDEN;
+
+            batch.push_back({ Utf8::decode(name), ino, dir.ref, attributes, size, modifiedTime });
+
+            if (isDir && !shouldSkipDirectory(name)) {
+                std::string path = dir.path;
+                if (path.back() != '/') path += '/';
+                path += name;
+                found.push_back({ std::move(path), ino });
+            }
+        };
+
+#if defined(__linux__)
+        struct LinuxDirent64 {
+            uint64_t d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+
+        alignas(8) char buffer[64 * 1024];
+        for (;;) {
+            long n = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (n <= 0 || cancel) break;
+            for (long off = 0; off < n;) {
+                auto* d = reinterpret_cast<LinuxDirent64*>(buffer + off);
+                entry(d->d_name, d->d_ino, d->d_type);
+                off += d->d_reclen;
+            }
+        }
+        close(fd);
+#else
+        DIR* d = fdopendir(fd);
+        if (!d) {
+            close(fd);
+            return;
+        }
+        while (dirent* e = readdir(d)) {
+            if (cancel) break;
+            entry(e->d_name, e->d_ino, e->d_type);
+        }
+        closedir(d);
+#endif
+    }
+
+    // the entry itself is still reported, like MftEnumerator's fallback walk
+    static bool shouldSkipDirectory(const char* name) {
+        static const char* skipDirs[] = { "node_modules", ".git", "__pycache__", nullptr };
+        for (int i = 0; skipDirs[i] != nullptr; ++i) {
+            if (strcmp(name, skipDirs[i]) == 0) return true;
+        }
+        return false;
+    }
+
+    unsigned threads_;
+    bool readMetadata_ = false;
+    dev_t device_ = 0;
+    Callback callback_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Dir> pending_;
+    unsigned busy_ = 0;
+
+    std::mutex callbackMutex_;
+};
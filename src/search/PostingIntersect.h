@@ -0,0 +1,215 @@
+#pragma once
+
+#include "PostingList.h"
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <bit>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <immintrin.h>
+#define VELOCITTY_SIMD_SSE2 1
+#endif
+
+// Sorted in-memory postings (e.g. TrigramIndex lists, cached candidate sets)
+// exposed through the same cursor interface as PostingList.
+class SpanPostings {
+public:
+    class Iterator {
+    public:
+        Iterator() = default;
+        explicit Iterator(std::span<const uint32_t> data)
+            : cur_(data.data()), end_(data.data() + data.size()) {}
+
+        uint32_t operator*() const { return *cur_; }
+        Iterator& operator++() { ++cur_; return *this; }
+        bool operator==(std::default_sentinel_t) const { return cur_ == end_; }
+
+        void seek(uint32_t target) { cur_ = gallopLowerBound(cur_, end_, target); }
+
+        std::span<const uint32_t> block() const {
+            return { cur_, static_cast<size_t>(end_ - cur_) };
+        }
+        void advance(uint32_t n) { cur_ += n; }
+
+    private:
+        const uint32_t* cur_ = nullptr;
+        const uint32_t* end_ = nullptr;
+    };
+
+    SpanPostings() = default;
+    SpanPostings(std::span<const uint32_t> data) : data_(data) {}
+
+    uint32_t size() const { return static_cast<uint32_t>(data_.size()); }
+    bool empty() const { return data_.empty(); }
+
+    Iterator begin() const { return Iterator(data_); }
+    std::default_sentinel_t end() const { return {}; }
+
+    void decodeTo(std::vector<uint32_t>& out) const {
+        out.insert(out.end(), data_.begin(), data_.end());
+    }
+
+private:
+    std::span<const uint32_t> data_;
+};
+
+// Intersects sorted posting lists without copying or re-sorting them.
+// Lists are visited from shortest to longest; the running result is
+// intersected with each next list either by galloping (seek) through the
+// longer list when the size gap is large, or by a block-wise SIMD merge
+// when sizes are similar.
+class PostingIntersector {
+public:
+    // beyond this size ratio galloping beats a linear merge
+    static constexpr uint32_t GALLOP_RATIO = 32;
+
+    template <typename List>
+    static std::vector<uint32_t> intersect(std::vector<List> lists) {
+        std::vector<uint32_t> result;
+        if (lists.empty()) return result;
+
+        std::sort(lists.begin(), lists.end(),
+            [](const List& a, const List& b) { return a.size() < b.size(); });
+
+        if (lists.front().empty()) return result;
+
+        lists.front().decodeTo(result);
+
+        std::vector<uint32_t> scratch;
+        for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+            scratch.resize(result.size());
+            size_t n = intersectWith(result, lists[i], scratch.data());
+            scratch.resize(n);
+            result.swap(scratch);
+        }
+
+        return result;
+    }
+
+    // Writes (sorted ∩ list) to out, which needs room for sorted.size() ids.
+    template <typename List>
+    static size_t intersectWith(std::span<const uint32_t> sorted, const List& list, uint32_t* out) {
+        if (sorted.empty() || list.empty()) return 0;
+
+        if (list.size() / sorted.size() >= GALLOP_RATIO) {
+            return gallop(sorted, list.begin(), out);
+        }
+        return merge(SpanPostings::Iterator(sorted), list.begin(), out);
+    }
+
+private:
+    template <typename Cursor>
+    static size_t gallop(std::span<const uint32_t> small, Cursor large, uint32_t* out) {
+        size_t n = 0;
+        for (uint32_t id : small) {
+            large.seek(id);
+            if (large == std::default_sentinel) break;
+            if (*large == id) out[n++] = id;
+        }
+        return n;
+    }
+
+    // Streams both cursors block by block; each step intersects the decoded
+    // remainders and advances whichever side was consumed.
+    template <typename CursorA, typename CursorB>
+    static size_t merge(CursorA a, CursorB b, uint32_t* out) {
+        size_t n = 0;
+        while (a != std::default_sentinel && b != std::default_sentinel) {
+            auto ba = a.block();
+            auto bb = b.block();
+
+            // cheap block-level skip before touching any ids
+            if (ba.back() < bb.front()) {
+                a.seek(bb.front());
+                continue;
+            }
+            if (bb.back() < ba.front()) {
+                b.seek(ba.front());
+                continue;
+            }
+
+            size_t usedA = 0;
+            size_t usedB = 0;
+            n += intersectBlocks(ba.data(), ba.size(), bb.data(), bb.size(),
+                                 out + n, usedA, usedB);
+            a.advance(static_cast<uint32_t>(usedA));
+            b.advance(static_cast<uint32_t>(usedB));
+        }
+        return n;
+    }
+
+    // Merges until one side runs out; reports how much of each side was consumed.
+    static size_t intersectBlocks(const uint32_t* a, size_t na, const uint32_t* b, size_t nb,
+                                  uint32_t* out, size_t& usedA, size_t& usedB) {
+        size_t i = 0;
+        size_t j = 0;
+        size_t n = 0;
+
+#if defined(__AVX2__)
+        while (i + 8 <= na && j + 8 <= nb) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+            const __m256i rot = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+
+            __m256i eq = _mm256_cmpeq_epi32(va, vb);
+            for (int r = 1; r < 8; ++r) {
+                vb = _mm256_permutevar8x32_epi32(vb, rot);
+                eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+            }
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+            while (mask) {
+                out[n++] = a[i + std::countr_zero(mask)];
+                mask &= mask - 1;
+            }
+
+            uint32_t maxA = a[i + 7];
+            uint32_t maxB = b[j + 7];
+            if (maxA <= maxB) i += 8;
+            if (maxB <= maxA) j += 8;
+        }
+#endif
+
+#if defined(VELOCITTY_SIMD_SSE2)
+        while (i + 4 <= na && j + 4 <= nb) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+            __m128i eq = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+            while (mask) {
+                out[n++] = a[i + std::countr_zero(mask)];
+                mask &= mask - 1;
+            }
+
+            uint32_t maxA = a[i + 3];
+            uint32_t maxB = b[j + 3];
+            if (maxA <= maxB) i += 4;
+            if (maxB <= maxA) j += 4;
+        }
+#endif
+
+        while (i < na && j < nb) {
+            if (a[i] < b[j]) {
+                ++i;
+            } else if (b[j] < a[i]) {
+                ++j;
+            } else {
+                out[n++] = a[i];
+                ++i;
+                ++j;
+            }
+        }
+
+        usedA = i;
+        usedB = j;
+        return n;
+    }
+};
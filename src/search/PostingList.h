@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <iterator>
+#include <algorithm>
+
+// Posting lists are stored as blocks of up to 128 sorted file indices. Each
+// block keeps its first doc raw and bit-packs the remaining gaps (delta - 1)
+// at a fixed width. The block table doubles as a skip list: lastDoc lets a
+// cursor jump over whole blocks without touching their packed data.
+
+#pragma pack(push, 1)
+struct DiskPostingBlock {
+    uint32_t firstDoc;
+    uint32_t lastDoc;
+    uint32_t dataOffset;  // in uint32_t words into the packed posting data
+    uint8_t bitWidth;
+    uint8_t count;
+    uint16_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DiskPostingBlock) == 16, "DiskPostingBlock size mismatch");
+
+// Exponential probe from the front of [first, last) followed by a binary
+// search in the bracketed range. Cheaper than lower_bound when the target
+// is usually close to first, which is the common case when intersecting.
+inline const uint32_t* gallopLowerBound(const uint32_t* first, const uint32_t* last, uint32_t target) {
+    size_t n = static_cast<size_t>(last - first);
+    size_t lo = 0;
+    size_t step = 1;
+    while (step < n && first[step] < target) {
+        lo = step;
+        step <<= 1;
+    }
+    size_t hi = std::min(step + 1, n);
+    return std::lower_bound(first + lo, first + hi, target);
+}
+
+class PostingCodec {
+public:
+    static constexpr uint32_t BLOCK_SIZE = 128;
+
+    static uint32_t blockCountFor(uint32_t postingCount) {
+        return (postingCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    // docs must be strictly increasing
+    static void encode(std::span<const uint32_t> docs,
+                       std::vector<DiskPostingBlock>& blocks,
+                       std::vector<uint32_t>& words) {
+        for (size_t start = 0; start < docs.size(); start += BLOCK_SIZE) {
+            size_t count = std::min<size_t>(BLOCK_SIZE, docs.size() - start);
+            const uint32_t* d = docs.data() + start;
+
+            uint32_t maxGap = 0;
+            for (size_t i = 1; i < count; ++i) {
+                maxGap = std::max(maxGap, d[i] - d[i - 1] - 1);
+            }
+
+            DiskPostingBlock block{};
+            block.firstDoc = d[0];
+            block.lastDoc = d[count - 1];
+            block.dataOffset = static_cast<uint32_t>(words.size());
+            block.bitWidth = static_cast<uint8_t>(bitsNeeded(maxGap));
+            block.count = static_cast<uint8_t>(count);
+            blocks.push_back(block);
+
+            if (block.bitWidth == 0) continue;
+
+            uint64_t acc = 0;
+            uint32_t accBits = 0;
+            for (size_t i = 1; i < count; ++i) {
+                acc |= static_cast<uint64_t>(d[i] - d[i - 1] - 1) << accBits;
+                accBits += block.bitWidth;
+                if (accBits >= 32) {
+                    words.push_back(static_cast<uint32_t>(acc));
+                    acc >>= 32;
+                    accBits -= 32;
+                }
+            }
+            if (accBits > 0) {
+                words.push_back(static_cast<uint32_t>(acc));
+            }
+        }
+    }
+
+    // out must have room for block.count values
+    static void decodeBlock(const DiskPostingBlock& block, const uint32_t* words, uint32_t* out) {
+        uint32_t doc = block.firstDoc;
+        out[0] = doc;
+
+        const uint32_t bw = block.bitWidth;
+        if (bw == 0) {
+            for (uint32_t i = 1; i < block.count; ++i) {
+                out[i] = ++doc;
+            }
+            return;
+        }
+
+        const uint32_t* src = words + block.dataOffset;
+        const uint64_t mask = (bw == 32) ? 0xFFFFFFFFULL : ((1ULL << bw) - 1);
+        uint32_t bitPos = 0;
+
+        for (uint32_t i = 1; i < block.count; ++i) {
+            uint32_t word = bitPos >> 5;
+            uint32_t shift = bitPos & 31;
+            uint64_t v = src[word] >> shift;
+            if (shift + bw > 32) {
+                v |= static_cast<uint64_t>(src[word + 1]) << (32 - shift);
+            }
+            doc += static_cast<uint32_t>(v & mask) + 1;
+            out[i] = doc;
+            bitPos += bw;
+        }
+    }
+
+private:
+    static uint32_t bitsNeeded(uint32_t v) {
+        uint32_t bits = 0;
+        while (v) {
+            ++bits;
+            v >>= 1;
+        }
+        return bits;
+    }
+};
+
+// Read-only view over one trigram's compressed postings inside the mapped index.
+class PostingList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        explicit Iterator(const PostingList& list)
+            : blocks_(list.blocks_), words_(list.words_), blockCount_(list.blockCount_) {
+            if (blockCount_ > 0) {
+                loadBlock(0);
+            }
+        }
+
+        uint32_t operator*() const { return buffer_[pos_]; }
+
+        Iterator& operator++() {
+            if (++pos_ >= bufferCount_) {
+                if (block_ + 1 < blockCount_) {
+                    loadBlock(block_ + 1);
+                } else {
+                    bufferCount_ = 0;
+                    pos_ = 0;
+                }
+            }
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return bufferCount_ == 0; }
+
+        // Decoded ids left in the current block, starting at the cursor.
+        std::span<const uint32_t> block() const {
+            return { buffer_ + pos_, bufferCount_ - pos_ };
+        }
+
+        // Moves n ids forward within the current block (n <= block().size()).
+        void advance(uint32_t n) {
+            pos_ += n;
+            if (pos_ >= bufferCount_) {
+                pos_ = bufferCount_ - 1;
+                ++*this;
+            }
+        }
+
+        // Advances to the first doc >= target. Blocks whose lastDoc is below
+        // the target are skipped without being decoded.
+        void seek(uint32_t target) {
+            if (bufferCount_ == 0) return;
+            if (buffer_[pos_] >= target) return;
+
+            if (blocks_[block_].lastDoc < target) {
+                auto first = blocks_ + block_ + 1;
+                auto last = blocks_ + blockCount_;
+                auto it = std::partition_point(first, last,
+                    [target](const DiskPostingBlock& b) { return b.lastDoc < target; });
+                if (it == last) {
+                    bufferCount_ = 0;
+                    pos_ = 0;
+                    return;
+                }
+                loadBlock(static_cast<uint32_t>(it - blocks_));
+            }
+
+            pos_ = static_cast<uint32_t>(
+                gallopLowerBound(buffer_ + pos_, buffer_ + bufferCount_, target) - buffer_);
+        }
+
+    private:
+        void loadBlock(uint32_t block) {
+            block_ = block;
+            const auto& b = blocks_[block];
+            PostingCodec::decodeBlock(b, words_, buffer_);
+            bufferCount_ = b.count;
+            pos_ = 0;
+        }
+
+        const DiskPostingBlock* blocks_ = nullptr;
+        const uint32_t* words_ = nullptr;
+        uint32_t blockCount_ = 0;
+        uint32_t block_ = 0;
+        uint32_t pos_ = 0;
+        uint32_t bufferCount_ = 0;
+        uint32_t buffer_[PostingCodec::BLOCK_SIZE];
+    };
+
+    PostingList() = default;
+    PostingList(const DiskPostingBlock* blocks, const uint32_t* words, uint32_t count)
+        : blocks_(blocks), words_(words), count_(count),
+          blockCount_(PostingCodec::blockCountFor(count)) {}
+
+    uint32_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    Iterator begin() const { return Iterator(*this); }
+    std::default_sentinel_t end() const { return {}; }
+
+    void decodeTo(std::vector<uint32_t>& out) const {
+        size_t base = out.size();
+        out.resize(base + count_);
+        for (uint32_t b = 0; b < blockCount_; ++b) {
+            PostingCodec::decodeBlock(blocks_[b], words_, out.data() + base);
+            base += blocks_[b].count;
+        }
+    }
+
+private:
+    const DiskPostingBlock* blocks_ = nullptr;
+    const uint32_t* words_ = nullptr;
+    uint32_t count_ = 0;
+    uint32_t blockCount_ = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string_view>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Every match of the last fully scanned query, so type-ahead can narrow
+// them instead of going back to the index. Appending to a query can only
+// shrink its match set - for substrings and for fuzzy subsequences alike -
+// so while the index is unchanged an extension only needs to look at the
+// previous matches.
+class QueryCache {
+public:
+    // larger match sets are not kept; the next keystroke rescans instead
+    static constexpr size_t MAX_MATCHES = 1 << 22;
+
+    using Matches = std::shared_ptr<const std::vector<uint32_t>>;
+
+    // The cached matches if foldedQuery extends the cached query under the
+    // same directory scope, mode and index generation, otherwise null.
+    Matches narrowFrom(std::wstring_view scope, std::wstring_view foldedQuery, bool fuzzy,
+                       uint64_t generation) const {
+        std::lock_guard lock(mutex_);
+        if (!matches_ || fuzzy != fuzzy_ || generation != generation_ || scope != scope_) return nullptr;
+        if (foldedQuery.size() < query_.size() || foldedQuery.substr(0, query_.size()) != query_) {
+            return nullptr;
+        }
+        return matches_;
+    }
+
+    // matches must be sorted by entry index
+    void store(std::wstring scope, std::wstring foldedQuery, bool fuzzy, uint64_t generation,
+               std::vector<uint32_t> matches) {
+        auto shared = std::make_shared<const std::vector<uint32_t>>(std::move(matches));
+        std::lock_guard lock(mutex_);
+        scope_ = std::move(scope);
+        query_ = std::move(foldedQuery);
+        fuzzy_ = fuzzy;
+        generation_ = generation;
+        matches_ = std::move(shared);
+    }
+
+    void clear() {
+        std::lock_guard lock(mutex_);
+        query_.clear();
+        matches_.reset();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::wstring scope_;
+    std::wstring query_;
+    bool fuzzy_ = false;
+    uint64_t generation_ = 0;
+    Matches matches_;
+};
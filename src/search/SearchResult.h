@@ -1,6 +1,8 @@
 #pragma once
 
-#include "../../framework.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
 
 struct SearchResult {
     std::wstring fullPath;
@@ -9,6 +11,8 @@ struct SearchResult {
     int score = 0;
     size_t matchStart = 0;
     size_t matchLen = 0;
+    uint64_t refKey = 0;  // DiskIndex::makeRefKey of the entry
+    uint32_t line = 0;    // content matches: 1-based line, displayName is its text
 
     bool operator<(const SearchResult& other) const {
         return score > other.score;
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "DiskIndex.h"
+#include "PostingIntersect.h"
+#include <string_view>
+#include <unordered_set>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Directory restriction from the path terms of a query: "src/render glyph"
+// looks for glyph anywhere below a directory render whose parent is src.
+// Components name whole directories (case-insensitively); a leading "c:"
+// anchors the path at that drive's root. A query made only of a path term
+// searches its last component as the name, so "src/glyph" works too,
+// unless metadata operators stand in for the name ("src/render ext:cpp").
+//
+// Base entries are stored in pre-order, so each matched directory covers a
+// contiguous range of base indices and candidates are narrowed with range
+// checks rather than by building paths. Entries added since the last
+// compaction are checked by walking their parents.
+class SearchScope {
+public:
+    struct Range {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    // Moves every path term (one containing / or \) of query into
+    // pathTerms, folded, and returns what is left as the name query.
+    // nameFromPath: with nothing left, the last path component is the name.
+    static std::wstring split(std::wstring_view query, std::vector<std::wstring>& pathTerms,
+                              bool nameFromPath = true) {
+        pathTerms.clear();
+
+        std::wstring rest;
+        std::wstring_view lastTerm;
+        size_t i = 0;
+        while (i < query.size()) {
+            size_t start = i;
+            while (i < query.size() && query[i] != L' ') ++i;
+            std::wstring_view term = query.substr(start, i - start);
+
+            if (term.find_first_of(L"/\\") != std::wstring_view::npos) {
+                pathTerms.push_back(CaseFold::fold(term));
+                lastTerm = term;
+                while (i < query.size() && query[i] == L' ') ++i;  // drop the gap it leaves
+                continue;
+            }
+
+            rest.append(term);
+            for (; i < query.size() && query[i] == L' '; ++i) rest.push_back(L' ');
+        }
+
+        while (!rest.empty() && rest.back() == L' ') rest.pop_back();
+
+        if (nameFromPath && rest.empty() && !pathTerms.empty()) {
+            size_t sep = lastTerm.find_last_of(L"/\\");
+            rest = lastTerm.substr(sep + 1);
+            pathTerms.back().resize(sep);
+        }
+        return rest;
+    }
+
+    // Finds the directories every path term names; false if some term
+    // names none, in which case nothing can match.
+    bool resolve(const DiskIndex& index, const std::vector<std::wstring>& pathTerms) {
+        terms_.clear();
+        ranges_.clear();
+        bool first = true;
+
+        for (const auto& term : pathTerms) {
+            std::vector<std::wstring_view> components;
+            size_t start = 0;
+            for (size_t i = 0; i <= term.size(); ++i) {
+                if (i == term.size() || term[i] == L'/' || term[i] == L'\\') {
+                    if (i > start) components.push_back(std::wstring_view(term).substr(start, i - start));
+                    start = i + 1;
+                }
+            }
+            if (components.empty()) continue;
+
+            TermScope scope;
+            std::vector<Range> ranges;
+            if (!resolveTerm(index, components, scope, ranges)) return false;
+
+            ranges_ = first ? std::move(ranges) : intersect(ranges_, ranges);
+            terms_.push_back(std::move(scope));
+            first = false;
+        }
+        return true;
+    }
+
+    bool active() const { return !terms_.empty(); }
+
+    // Base index ranges covering every scoped base entry.
+    const std::vector<Range>& ranges() const { return ranges_; }
+
+    // The ids in [first, last) of a sorted list that fall in a range;
+    // delta entries (>= baseCount) are all kept for contains() to check.
+    void restrict(const std::vector<uint32_t>& ids, uint32_t first, uint32_t last, uint32_t baseCount,
+                  std::vector<uint32_t>& out) const {
+        out.clear();
+        auto begin = ids.begin() + first;
+        auto end = ids.begin() + last;
+
+        for (const auto& r : ranges_) {
+            auto lo = std::lower_bound(begin, end, r.first);
+            auto hi = std::lower_bound(lo, end, r.last);
+            out.insert(out.end(), lo, hi);
+            begin = hi;
+        }
+        out.insert(out.end(), std::lower_bound(begin, end, baseCount), end);
+    }
+
+    // Calls fn(first, last) for each part of [first, last) that is in scope.
+    template <typename Fn>
+    void forEachRange(uint32_t first, uint32_t last, uint32_t baseCount, Fn&& fn) const {
+        for (const auto& r : ranges_) {
+            uint32_t lo = std::max(first, r.first);
+            uint32_t hi = std::min(last, r.last);
+            if (lo < hi) fn(lo, hi);
+        }
+        if (std::max(first, baseCount) < last) fn(std::max(first, baseCount), last);
+    }
+
+    // Whether idx lies below a directory of every term, following current
+    // parents (delta renames and moves included).
+    bool contains(const DiskIndex& index, uint32_t idx) const {
+        for (const auto& term : terms_) {
+            if (term.drive >= 0) {
+                if (index.entry(idx).driveIndex != term.drive) return false;
+                continue;
+            }
+
+            bool found = false;
+            uint32_t current = idx;
+            for (size_t depth = 0; depth < MAX_DEPTH && !found; ++depth) {
+                current = index.parentOf(current);
+                if (current == DiskIndex::NO_PARENT) break;
+                found = term.dirs.contains(current);
+            }
+            if (!found) return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t MAX_DEPTH = 1024;
+
+    struct TermScope {
+        std::unordered_set<uint32_t> dirs;  // matched directories
+        int drive = -1;                     // or a whole drive ("c:")
+    };
+
+    static bool isDriveComponent(std::wstring_view c) {
+        return c.size() == 2 && c[1] == L':' && c[0] >= L'a' && c[0] <= L'z';
+    }
+
+    bool resolveTerm(const DiskIndex& index, const std::vector<std::wstring_view>& components,
+                     TermScope& scope, std::vector<Range>& ranges) const {
+        std::wstring_view leaf = components.back();
+        if (isDriveComponent(leaf)) {
+            // top-level entries head the subtrees that make up the drive
+            scope.drive = leaf[0] - L'a';
+            for (uint32_t idx = 0; idx < index.baseEntryCount(); idx = index.subtreeEnd(idx)) {
+                if (index.entry(idx).driveIndex == scope.drive) ranges.push_back({ idx, index.subtreeEnd(idx) });
+            }
+            mergeRanges(ranges);
+            return true;
+        }
+
+        auto& dirs = scope.dirs;
+
+        auto consider = [&](uint32_t idx) {
+            if (idx >= index.entryCount() || index.isDeleted(idx)) return;  // postings of a damaged index
+            if (!(index.entry(idx).attributes & FileAttributes::DIRECTORY)) return;
+            if (index.getFoldedName(idx) != leaf) return;
+            if (!ancestorsMatch(index, idx, components)) return;
+
+            dirs.insert(idx);
+            if (idx < index.baseEntryCount()) {
+                ranges.push_back({ idx + 1, index.subtreeEnd(idx) });
+                return;
+            }
+
+            // a renamed or moved directory keeps its base children until compaction
+            const auto& e = index.entry(idx);
+            uint32_t old = index.findBaseEntry(DiskIndex::makeRefKey(e.driveIndex, e.fileRef));
+            if (old != DiskIndex::NOT_FOUND) ranges.push_back({ old + 1, index.subtreeEnd(old) });
+        };
+
+        for (uint32_t idx : namedCandidates(index, leaf)) consider(idx);
+        for (uint32_t idx = index.baseEntryCount(); idx < index.entryCount(); ++idx) consider(idx);
+
+        mergeRanges(ranges);
+        return !dirs.empty();
+    }
+
+    // Base entries that may be named exactly name (folded).
+    static std::vector<uint32_t> namedCandidates(const DiskIndex& index, std::wstring_view name) {
+        std::vector<PostingList> lists = { index.getPostings(DiskIndex::makeFirstCharKey(name[0])) };
+        if (name.size() > 1) {
+            lists.push_back(index.getPostings(DiskIndex::makeBigram(name[0], name[1])));
+        }
+        for (size_t i = 0; i + 2 < name.size(); ++i) {
+            lists.push_back(index.getPostings(DiskIndex::makeTrigram(name[i], name[i + 1], name[i + 2])));
+        }
+        return PostingIntersector::intersect(std::move(lists));
+    }
+
+    // The leading components name idx's parent, grandparent, ... in turn.
+    static bool ancestorsMatch(const DiskIndex& index, uint32_t idx,
+                               const std::vector<std::wstring_view>& components) {
+        uint32_t current = idx;
+        for (size_t c = components.size() - 1; c-- > 0;) {
+            if (isDriveComponent(components[c])) {
+                return c == 0 && index.parentOf(current) == DiskIndex::NO_PARENT &&
+                       index.entry(current).driveIndex == components[c][0] - L'a';
+            }
+            current = index.parentOf(current);
+            if (current == DiskIndex::NO_PARENT || index.getFoldedName(current) != components[c]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Sorted, with nested ranges (a match inside another match) dropped.
+    static void mergeRanges(std::vector<Range>& ranges) {
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const Range& a, const Range& b) { return a.first < b.first; });
+        std::vector<Range> merged;
+        for (const auto& r : ranges) {
+            if (r.first >= r.last) continue;
+            if (!merged.empty() && r.first <= merged.back().last) {
+                merged.back().last = std::max(merged.back().last, r.last);
+            } else {
+                merged.push_back(r);
+            }
+        }
+        ranges = std::move(merged);
+    }
+
+    static std::vector<Range> intersect(const std::vector<Range>& a, const std::vector<Range>& b) {
+        std::vector<Range> out;
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.size() && j < b.size()) {
+            uint32_t lo = std::max(a[i].first, b[j].first);
+            uint32_t hi = std::min(a[i].last, b[j].last);
+            if (lo < hi) out.push_back({ lo, hi });
+            if (a[i].last < b[j].last) ++i; else ++j;
+        }
+        return out;
+    }
+
+    std::vector<TermScope> terms_;
+    std::vector<Range> ranges_;
+};
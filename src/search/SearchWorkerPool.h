@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Helper threads that live as long as the search service and join in on
+// one query at a time. run() hands the same job to every helper and to the
+// calling thread, which makes the caller worker 0, so a pool of size 1 has
+// no helpers at all and just runs the job inline.
+class SearchWorkerPool {
+public:
+    using Job = std::function<void(size_t worker)>;
+
+    // one thread per core, leaving one for the UI
+    static size_t defaultSize() {
+        unsigned cores = std::thread::hardware_concurrency();
+        return std::clamp<size_t>(cores > 1 ? cores - 1 : 1, 1, MAX_WORKERS);
+    }
+
+    explicit SearchWorkerPool(size_t size = defaultSize()) {
+        size = std::max<size_t>(size, 1);
+        helpers_.reserve(size - 1);
+        for (size_t i = 1; i < size; ++i) {
+            helpers_.emplace_back([this, i]() { helperLoop(i); });
+        }
+    }
+
+    ~SearchWorkerPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        jobCv_.notify_all();
+        for (auto& t : helpers_) {
+            t.join();
+        }
+    }
+
+    SearchWorkerPool(const SearchWorkerPool&) = delete;
+    SearchWorkerPool& operator=(const SearchWorkerPool&) = delete;
+
+    size_t size() const { return helpers_.size() + 1; }
+
+    // Returns once every worker has finished the job. Only one thread may
+    // call this at a time.
+    void run(const Job& job) {
+        if (helpers_.empty()) {
+            job(0);
+            return;
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            job_ = &job;
+            busy_ = helpers_.size();
+            ++generation_;
+        }
+        jobCv_.notify_all();
+
+        job(0);
+
+        std::unique_lock lock(mutex_);
+        doneCv_.wait(lock, [this]() { return busy_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    static constexpr size_t MAX_WORKERS = 16;
+
+    void helperLoop(size_t worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            const Job* job;
+            {
+                std::unique_lock lock(mutex_);
+                jobCv_.wait(lock, [&]() { return stopping_ || generation_ != seen; });
+                if (stopping_) return;
+                seen = generation_;
+                job = job_;
+            }
+
+            (*job)(worker);
+
+            bool last;
+            {
+                std::lock_guard lock(mutex_);
+                last = --busy_ == 0;
+            }
+            if (last) doneCv_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> helpers_;
+    std::mutex mutex_;
+    std::condition_variable jobCv_;
+    std::condition_variable doneCv_;
+    const Job* job_ = nullptr;
+    size_t busy_ = 0;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+struct RankedCandidate {
+    int score;
+    uint32_t index;
+    uint32_t matchStart;
+    uint32_t matchLen;
+};
+
+// Bounded min-heap keeping the K best-scoring candidates seen so far.
+// Candidates are only entry indices plus what was derived from the name,
+// so nothing expensive (full paths, strings) is built until the end.
+class TopKRanker {
+public:
+    explicit TopKRanker(size_t k) : k_(k) {
+        heap_.reserve(k);
+    }
+
+    bool offer(uint32_t index, int score, uint32_t matchStart, uint32_t matchLen) {
+        if (k_ == 0) return false;
+
+        if (heap_.size() < k_) {
+            heap_.push_back({ score, index, matchStart, matchLen });
+            std::push_heap(heap_.begin(), heap_.end(), worseFirst);
+            ++version_;
+            return true;
+        }
+
+        // ties keep the lower index, so the result doesn't depend on the
+        // order candidates arrive in
+        const auto& worst = heap_.front();
+        if (score < worst.score || (score == worst.score && index >= worst.index)) return false;
+
+        std::pop_heap(heap_.begin(), heap_.end(), worseFirst);
+        heap_.back() = { score, index, matchStart, matchLen };
+        std::push_heap(heap_.begin(), heap_.end(), worseFirst);
+        ++version_;
+        return true;
+    }
+
+    bool full() const { return heap_.size() >= k_; }
+    size_t size() const { return heap_.size(); }
+
+    // lowest score currently kept; nothing at or below it can enter once full
+    int threshold() const {
+        return heap_.empty() ? INT32_MIN : heap_.front().score;
+    }
+
+    // true once no further candidate scoring at most maxScore can change the result
+    bool saturated(int maxScore) const {
+        return full() && threshold() >= maxScore;
+    }
+
+    // bumps whenever the kept set changes, for cheap "anything new?" checks
+    uint64_t version() const { return version_; }
+
+    std::vector<RankedCandidate> sorted() const {
+        std::vector<RankedCandidate> out = heap_;
+        std::sort(out.begin(), out.end(), [](const RankedCandidate& a, const RankedCandidate& b) {
+            if (a.score != b.score) return a.score > b.score;
+            return a.index < b.index;
+        });
+        return out;
+    }
+
+    // Offers everything other kept; the result is as if both had seen
+    // each other's candidates.
+    void merge(const TopKRanker& other) {
+        for (const auto& c : other.heap_) {
+            offer(c.index, c.score, c.matchStart, c.matchLen);
+        }
+    }
+
+    void clear() {
+        heap_.clear();
+        ++version_;
+    }
+
+private:
+    static bool worseFirst(const RankedCandidate& a, const RankedCandidate& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.index < b.index;
+    }
+
+    size_t k_;
+    std::vector<RankedCandidate> heap_;
+    uint64_t version_ = 0;
+};
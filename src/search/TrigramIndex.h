@@ -1,9 +1,11 @@
 #pragma once
 
-#include "../../framework.h"
+#include "DiskIndex.h"
+#include "PostingIntersect.h"
 #include <unordered_map>
 #include <string_view>
-#include <iterator>
+#include <algorithm>
+#include <vector>
 
 class TrigramIndex {
 public:
@@ -19,10 +21,13 @@ public:
 
         for (size_t i = 0; i + 2 < name.size(); ++i) {
             uint32_t tri = makeTrigram(name[i], name[i + 1], name[i + 2]);
-            postings_[tri].push_back(fileIndex);
+            // a name can repeat a trigram; the intersector needs strictly increasing ids
+            auto& list = postings_[tri];
+            if (list.empty() || list.back() != fileIndex) list.push_back(fileIndex);
         }
     }
 
+    // Postings must be sorted: add files in index order or call sortPostings().
     std::vector<uint32_t> search(std::wstring_view query) const {
         if (query.empty()) return {};
 
@@ -30,36 +35,23 @@ public:
             return shortNames_;
         }
 
-        std::vector<uint32_t> result;
-        bool first = true;
-
+        std::vector<uint32_t> trigrams;
+        trigrams.reserve(query.size() - 2);
         for (size_t i = 0; i + 2 < query.size(); ++i) {
-            uint32_t tri = makeTrigram(query[i], query[i + 1], query[i + 2]);
+            trigrams.push_back(makeTrigram(query[i], query[i + 1], query[i + 2]));
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+        std::vector<SpanPostings> lists;
+        lists.reserve(trigrams.size());
+        for (uint32_t tri : trigrams) {
             auto it = postings_.find(tri);
             if (it == postings_.end()) return {};
-
-            if (first) {
-                result = it->second;
-                std::sort(result.begin(), result.end());
-                first = false;
-            } else {
-                std::vector<uint32_t> sorted = it->second;
-                std::sort(sorted.begin(), sorted.end());
-
-                std::vector<uint32_t> intersection;
-                intersection.reserve(std::min(result.size(), sorted.size()));
-                std::set_intersection(
-                    result.begin(), result.end(),
-                    sorted.begin(), sorted.end(),
-                    std::back_inserter(intersection)
-                );
-                result = std::move(intersection);
-            }
-
-            if (result.empty()) return {};
+            lists.emplace_back(it->second);
         }
 
-        return result;
+        return PostingIntersector::intersect(std::move(lists));
     }
 
     void clear() {
@@ -70,6 +62,7 @@ public:
     void sortPostings() {
         for (auto& [tri, list] : postings_) {
             std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
         }
     }
 
@@ -84,9 +77,7 @@ public:
 
 private:
     static uint32_t makeTrigram(wchar_t a, wchar_t b, wchar_t c) {
-        return (static_cast<uint32_t>(towlower(a)) & 0x3FF) |
-               ((static_cast<uint32_t>(towlower(b)) & 0x3FF) << 10) |
-               ((static_cast<uint32_t>(towlower(c)) & 0x3FF) << 20);
+        return DiskIndex::makeTrigram(CaseFold::fold(a), CaseFold::fold(b), CaseFold::fold(c));
     }
 
     std::unordered_map<uint32_t, std::vector<uint32_t>> postings_;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../../framework.h"
+#include "ChangeJournal.h"
+
+// Reads the NTFS change journal (USN) of every indexed volume, starting
+// from the positions saved with the index.
+class UsnJournalSource : public ChangeJournalSource {
+public:
+    explicit UsnJournalSource(std::vector<DriveMetadata> positions)
+        : positions_(std::move(positions)) {}
+
+    bool read(std::vector<JournalChange>& out, std::atomic<bool>& cancel) override {
+        for (auto& meta : positions_) {
+            if (cancel) break;
+            if (!readVolume(meta, out, cancel)) return false;
+        }
+        return true;
+    }
+
+    std::vector<DriveMetadata> positions() const override {
+        return positions_;
+    }
+
+    // Records where the journal currently ends, before a volume is scanned.
+    static void capturePosition(wchar_t drive, DriveMetadata& meta) {
+        HANDLE hVolume = openVolume(drive);
+        if (hVolume == INVALID_HANDLE_VALUE) return;
+
+        USN_JOURNAL_DATA_V0 journalData{};
+        DWORD bytesReturned;
+
+        if (DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL,
+                            nullptr, 0, &journalData, sizeof(journalData),
+                            &bytesReturned, nullptr)) {
+            meta.lastUsn = journalData.NextUsn;
+            meta.journalId = journalData.UsnJournalID;
+        }
+
+        CloseHandle(hVolume);
+    }
+
+private:
+    static HANDLE openVolume(wchar_t drive) {
+        wchar_t volumePath[8] = { L'\\', L'\\', L'.', L'\\', drive, L':', 0 };
+        return CreateFileW(volumePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           nullptr, OPEN_EXISTING, 0, nullptr);
+    }
+
+    bool readVolume(DriveMetadata& meta, std::vector<JournalChange>& out, std::atomic<bool>& cancel) {
+        // an unreachable volume (unplugged, no access) is skipped, not fatal
+        HANDLE hVolume = openVolume(meta.driveLetter);
+        if (hVolume == INVALID_HANDLE_VALUE) return true;
+
+        USN_JOURNAL_DATA_V0 journalData{};
+        DWORD bytesReturned;
+
+        if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL,
+                             nullptr, 0, &journalData, sizeof(journalData),
+                             &bytesReturned, nullptr)) {
+            CloseHandle(hVolume);
+            return true;
+        }
+
+        // recreated, or purged past the last record we saw
+        if (journalData.UsnJournalID != meta.journalId ||
+            static_cast<uint64_t>(journalData.FirstUsn) > meta.lastUsn) {
+            CloseHandle(hVolume);
+            return false;
+        }
+
+        uint8_t driveIndex = static_cast<uint8_t>(meta.driveLetter - L'A');
+
+        READ_USN_JOURNAL_DATA_V0 readData{};
+        readData.StartUsn = meta.lastUsn;
+        readData.ReasonMask = USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE |
+                              USN_REASON_RENAME_NEW_NAME | USN_REASON_RENAME_OLD_NAME;
+        readData.ReturnOnlyOnClose = FALSE;
+        readData.Timeout = 0;
+        readData.BytesToWaitFor = 0;
+        readData.UsnJournalID = meta.journalId;
+
+        std::vector<uint8_t> buffer(64 * 1024);
+
+        while (!cancel) {
+            if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL,
+                                 &readData, sizeof(readData),
+                                 buffer.data(), static_cast<DWORD>(buffer.size()),
+                                 &bytesReturned, nullptr)) {
+                break;
+            }
+
+            if (bytesReturned <= sizeof(USN)) break;
+
+            USN nextUsn = *reinterpret_cast<USN*>(buffer.data());
+            auto* record = reinterpret_cast<USN_RECORD*>(buffer.data() + sizeof(USN));
+            DWORD remaining = bytesReturned - sizeof(USN);
+
+            while (remaining > 0 && !cancel) {
+                if (record->RecordLength == 0) break;
+
+                appendRecord(*record, driveIndex, out);
+
+                remaining -= record->RecordLength;
+                record = reinterpret_cast<USN_RECORD*>(
+                    reinterpret_cast<uint8_t*>(record) + record->RecordLength);
+            }
+
+            readData.StartUsn = nextUsn;
+            meta.lastUsn = nextUsn;
+        }
+
+        CloseHandle(hVolume);
+        return true;
+    }
+
+    // Reasons accumulate while a file stays open, so one record can carry
+    // several; they are turned into the changes that leave the right state.
+    static void appendRecord(const USN_RECORD& record, uint8_t driveIndex, std::vector<JournalChange>& out) {
+        const DWORD reason = record.Reason;
+
+        bool removed = (reason & (USN_REASON_FILE_DELETE | USN_REASON_RENAME_OLD_NAME)) != 0;
+        bool added = !(reason & USN_REASON_FILE_DELETE) &&
+                     ((reason & USN_REASON_RENAME_NEW_NAME) ||
+                      ((reason & USN_REASON_FILE_CREATE) && !(reason & USN_REASON_RENAME_OLD_NAME)));
+
+        if (removed) {
+            out.push_back({ JournalChange::Kind::Removed, driveIndex, 0,
+                            record.FileReferenceNumber, record.ParentFileReferenceNumber, {} });
+        }
+        if (added) {
+            const auto* name = reinterpret_cast<const wchar_t*>(
+                reinterpret_cast<const uint8_t*>(&record) + record.FileNameOffset);
+            out.push_back({ JournalChange::Kind::Added, driveIndex, record.FileAttributes,
+                            record.FileReferenceNumber, record.ParentFileReferenceNumber,
+                            std::wstring(name, record.FileNameLength / sizeof(wchar_t)),
+                            FileMetadata::UNKNOWN_SIZE,
+                            FileMetadata::fromFileTime(static_cast<uint64_t>(record.TimeStamp.QuadPart)) });
+        }
+    }
+
+    std::vector<DriveMetadata> positions_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Conversion between UTF-8 bytes and the UTF-16 code units names and paths
+// are kept in, even where wchar_t is wider. Used for POSIX paths and file
+// names and for searching file contents, which are read as UTF-8.
+class Utf8 {
+public:
+    // unpaired surrogates are encoded as they are
+    static std::string encode(std::wstring_view text) {
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            uint32_t cp = static_cast<uint32_t>(text[i]);
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < text.size()) {
+                uint32_t low = static_cast<uint32_t>(text[i + 1]);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    ++i;
+                }
+            }
+
+            if (cp < 0x80) {
+                out.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else if (cp < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+        return out;
+    }
+
+    // bytes that aren't valid UTF-8 become U+FFFD
+    static std::wstring decode(std::string_view text) {
+        std::wstring out;
+        out.reserve(text.size());
+        const auto* s = reinterpret_cast<const unsigned char*>(text.data());
+        const auto* end = s + text.size();
+        while (s < end) {
+            uint32_t cp = *s;
+            int extra = cp < 0x80 ? 0 : (cp >> 5) == 0x6 ? 1 : (cp >> 4) == 0xE ? 2 : (cp >> 3) == 0x1E ? 3 : -1;
+            if (extra < 0) {
+                out.push_back(static_cast<wchar_t>(0xFFFD));
+                ++s;
+                continue;
+            }
+
+            if (extra) cp &= 0x3F >> extra;  // payload bits of the lead byte
+            int i = 1;
+            for (; i <= extra && s + i < end && (s[i] & 0xC0) == 0x80; ++i) {
+                cp = (cp << 6) | (s[i] & 0x3F);
+            }
+            s += i;
+            if (i <= extra) {
+                out.push_back(static_cast<wchar_t>(0xFFFD));
+                continue;
+            }
+
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                out.push_back(static_cast<wchar_t>(0xD800 | (cp >> 10)));
+                out.push_back(static_cast<wchar_t>(0xDC00 | (cp & 0x3FF)));
+                continue;
+            }
+            out.push_back(static_cast<wchar_t>(cp));
+        }
+        return out;
+    }
+};
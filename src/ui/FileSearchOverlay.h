@@ -26,7 +26,8 @@ public:
         selectedIndex_ = 0;
         scrollOffset_ = 0;
         action_ = Action::None;
-        selectedPath_.clear();
+        selected_ = {};
+        contentMode_ = false;
     }
 
     void hide() {
@@ -37,6 +38,7 @@ public:
 
     bool onChar(wchar_t ch) {
         if (!visible_) return false;
+        if (ch == L'\t') return true;  // the mode switch, already handled as VK_TAB
         if (ch < 32) return false;
 
         query_ += ch;
@@ -87,7 +89,7 @@ public:
             case VK_RETURN:
                 if (selectedIndex_ >= 0 && selectedIndex_ < static_cast<int>(results_.size())) {
                     const auto& r = results_[selectedIndex_];
-                    selectedPath_ = r.fullPath;
+                    selected_ = r;
 
                     if (r.isDirectory) {
                         action_ = Action::Cd;
@@ -100,6 +102,15 @@ public:
                 }
                 return true;
 
+            // switches between searching names and file contents
+            case VK_TAB:
+                contentMode_ = !contentMode_;
+                results_.clear();
+                selectedIndex_ = 0;
+                scrollOffset_ = 0;
+                searchTrigger_ = true;
+                return true;
+
             case VK_BACK:
                 if (!query_.empty()) {
                     query_.pop_back();
@@ -140,7 +151,7 @@ public:
                 selectedIndex_ = clickedIndex;
 
                 const auto& r = results_[selectedIndex_];
-                selectedPath_ = r.fullPath;
+                selected_ = r;
                 action_ = r.isDirectory ? Action::Cd : Action::InsertPath;
                 hide();
             }
@@ -185,6 +196,7 @@ public:
     }
 
     const std::wstring& getQuery() const { return query_; }
+    bool isContentMode() const { return contentMode_; }
     const std::vector<SearchResult>& getResults() const { return results_; }
     int getSelectedIndex() const { return selectedIndex_; }
     int getScrollOffset() const { return scrollOffset_; }
@@ -194,8 +206,9 @@ public:
 
     bool hasAction() const { return action_ != Action::None; }
     Action getAction() const { return action_; }
-    const std::wstring& getSelectedPath() const { return selectedPath_; }
-    void clearAction() { action_ = Action::None; selectedPath_.clear(); }
+    const std::wstring& getSelectedPath() const { return selected_.fullPath; }
+    const SearchResult& getSelectedResult() const { return selected_; }
+    void clearAction() { action_ = Action::None; selected_ = {}; }
 
     Rect getOverlayRect(float winW, float winH) const {
         float w = std::min(overlayWidth_, winW * 0.8f);
@@ -265,10 +278,11 @@ private:
     int scrollOffset_ = 0;
     float indexProgress_ = 0.0f;
     bool searchTrigger_ = false;
+    bool contentMode_ = false;
 
     float windowWidth_ = 0;
     float windowHeight_ = 0;
 
     Action action_ = Action::None;
-    std::wstring selectedPath_;
+    SearchResult selected_;
 };